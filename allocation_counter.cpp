@@ -0,0 +1,218 @@
+#include "allocation_counter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#ifdef COUNT_ALLOCATIONS
+
+// trivially initialized, usable before any constructor of the thread ran
+static thread_local uint64_t allocation_count = 0;
+static thread_local uint64_t webgpu_allocation_count = 0;
+static thread_local uint32_t uncounted_depth = 0;
+static thread_local uint32_t webgpu_depth = 0;
+
+static void count_allocation() {
+    if (uncounted_depth > 0) {
+        return;
+    }
+    if (webgpu_depth > 0) {
+        webgpu_allocation_count++;
+    } else {
+        allocation_count++;
+    }
+}
+
+static void* counted_malloc(std::size_t size) {
+    count_allocation();
+    return std::malloc(std::max<std::size_t>(size, 1));
+}
+
+static void* counted_aligned_malloc(std::size_t size, std::align_val_t alignment) {
+    count_allocation();
+    std::size_t align = static_cast<std::size_t>(alignment);
+#ifdef _WIN32
+    return _aligned_malloc(std::max<std::size_t>(size, 1), align);
+#else
+    // aligned_alloc wants a multiple of the alignment
+    return std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) & ~(align - 1));
+#endif
+}
+
+static void aligned_free(void* pointer) {
+#ifdef _WIN32
+    _aligned_free(pointer);
+#else
+    std::free(pointer);
+#endif
+}
+
+void* operator new(std::size_t size) {
+    if (void* pointer = counted_malloc(size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept {
+    return counted_malloc(size);
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept {
+    return counted_malloc(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    if (void* pointer = counted_aligned_malloc(size, alignment)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept {
+    return counted_aligned_malloc(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept {
+    return counted_aligned_malloc(size, alignment);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::nothrow_t const&) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::nothrow_t const&) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+    aligned_free(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept {
+    aligned_free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept {
+    aligned_free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept {
+    aligned_free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t, std::nothrow_t const&) noexcept {
+    aligned_free(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t, std::nothrow_t const&) noexcept {
+    aligned_free(pointer);
+}
+
+bool allocation_counting_enabled() {
+    return true;
+}
+
+uint64_t thread_allocation_count() {
+    return allocation_count;
+}
+
+uint64_t thread_webgpu_allocation_count() {
+    return webgpu_allocation_count;
+}
+
+UncountedAllocations::UncountedAllocations() {
+    uncounted_depth++;
+}
+
+UncountedAllocations::~UncountedAllocations() {
+    uncounted_depth--;
+}
+
+WebGPUAllocations::WebGPUAllocations() {
+    webgpu_depth++;
+}
+
+WebGPUAllocations::~WebGPUAllocations() {
+    webgpu_depth--;
+}
+
+#else
+
+bool allocation_counting_enabled() {
+    return false;
+}
+
+uint64_t thread_allocation_count() {
+    return 0;
+}
+
+uint64_t thread_webgpu_allocation_count() {
+    return 0;
+}
+
+UncountedAllocations::UncountedAllocations() {}
+
+UncountedAllocations::~UncountedAllocations() {}
+
+WebGPUAllocations::WebGPUAllocations() {}
+
+WebGPUAllocations::~WebGPUAllocations() {}
+
+#endif
+
+void FrameAllocationCheck::begin_frame() {
+    this->frame_start = thread_allocation_count();
+    this->webgpu_frame_start = thread_webgpu_allocation_count();
+}
+
+void FrameAllocationCheck::end_frame() {
+    if (!allocation_counting_enabled()) {
+        return;
+    }
+    uint64_t count = thread_allocation_count() - this->frame_start;
+    this->frame++;
+    if (this->frame < warm_up_frames) {
+        // the first frames fill caches and free lists
+        return;
+    }
+    if (this->frame == warm_up_frames) {
+        std::cout << "Allocations after warm-up: " << count << " of ours, "
+                  << thread_webgpu_allocation_count() - this->webgpu_frame_start
+                  << " in WebGPU calls per frame\n";
+    }
+    if (count > 0) {
+        std::cout << "Frame " << this->frame << " after warm-up made " << count
+                  << " allocations outside of WebGPU calls\n";
+        std::abort();
+    }
+}
+
+void FrameAllocationCheck::restart() {
+    this->frame = 0;
+}
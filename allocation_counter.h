@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+
+// Test mode for the steady-state frame path, built with -DCOUNT_ALLOCATIONS=ON: global operator
+// new is replaced to count the allocations of each thread, and RenderService checks every frame
+// with a FrameAllocationCheck. In regular builds nothing is counted and the checks pass.
+
+// Whether this build counts allocations.
+bool allocation_counting_enabled();
+
+// operator new calls of the calling thread so far, outside of UncountedAllocations and
+// WebGPUAllocations scopes.
+uint64_t thread_allocation_count();
+
+// operator new calls of the calling thread so far inside WebGPUAllocations scopes.
+uint64_t thread_webgpu_allocation_count();
+
+// Allocations in its scope are not counted, for work the frame only hands data to (view callbacks).
+class UncountedAllocations {
+public:
+    UncountedAllocations();
+
+    ~UncountedAllocations();
+
+    UncountedAllocations(UncountedAllocations const&) = delete;
+    UncountedAllocations& operator=(UncountedAllocations const&) = delete;
+};
+
+// Allocations in its scope are made by the WebGPU implementation (encoders, command buffers,
+// futures) through the same operator new. They are counted separately and not held against the
+// frame. Keep the scopes to the WebGPU calls; callbacks run by WaitAny and ProcessEvents are
+// counted with the call that runs them.
+class WebGPUAllocations {
+public:
+    WebGPUAllocations();
+
+    ~WebGPUAllocations();
+
+    WebGPUAllocations(WebGPUAllocations const&) = delete;
+    WebGPUAllocations& operator=(WebGPUAllocations const&) = delete;
+};
+
+// Fails when a frame after warm-up allocates outside of WebGPU calls. The counts of the last
+// warm-up frame are printed.
+class FrameAllocationCheck {
+public:
+    static constexpr uint32_t warm_up_frames = 120;
+
+    void begin_frame();
+
+    // Aborts when the frame allocated after warm-up.
+    void end_frame();
+
+    // Frames that create resources (new or resized views, reloaded shaders, new glyphs) allocate
+    // legitimately and start the warm-up over.
+    void restart();
+
+private:
+    uint64_t frame_start = 0;
+    uint64_t webgpu_frame_start = 0;
+    uint32_t frame = 0;
+};
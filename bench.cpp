@@ -0,0 +1,160 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include <imgui/imgui.h>
+
+#include "compact_vertex.h"
+#include "imgui_helpers.h"
+#include "render_service.h"
+
+using namespace wgpu;
+
+int run_view_benchmark(int max_views) {
+    const uint32_t view_size = 400;
+    const int warmup_frames = 10;
+    const int measured_frames = 100;
+
+    RenderService service;
+    service.set_overlay_enabled(false);
+    service.init();
+    if (!service.get_gpu().device) {
+        std::printf("No WebGPU device\n");
+        return 1;
+    }
+    if (!service.wait_until_ready()) {
+        std::printf("Pipeline creation failed\n");
+        return 1;
+    }
+
+    std::vector<ViewId> views;
+    std::printf("%8s %14s %14s\n", "views", "frame (ms)", "per view (ms)");
+    for (int count = 1; count <= max_views; count *= 2) {
+        while (views.size() < static_cast<size_t>(count)) {
+            ViewId id = service.add_view(nullptr);
+            service.update_view(id, view_size, view_size, 0.0f);
+            views.push_back(id);
+        }
+
+        for (int i = 0; i < warmup_frames; i++) {
+            service.render_frame();
+        }
+        wait_for_queue(service.get_gpu());
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < measured_frames; i++) {
+            service.render_frame();
+        }
+        wait_for_queue(service.get_gpu());
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        double frame_ms = elapsed.count() / measured_frames;
+        std::printf("%8d %14.3f %14.3f\n", count, frame_ms, frame_ms / count);
+    }
+
+    for (ViewId id : views) {
+        service.remove_view(id);
+    }
+    service.release();
+    return 0;
+}
+
+int run_ui_vertex_benchmark(int frames) {
+    const uint32_t width = 1920;
+    const uint32_t height = 1080;
+    const int line_count = 120;
+
+    GPU gpu = init_webgpu();
+    if (!gpu.device) {
+        std::printf("No WebGPU device\n");
+        return 1;
+    }
+    TextureDescriptor target_desc{
+        .usage = TextureUsage::RenderAttachment,
+        .size = {.width = width, .height = height},
+        .format = TextureFormat::BGRA8Unorm,
+    };
+    Texture target = gpu.device.CreateTexture(&target_desc);
+
+    int result = 0;
+    std::printf("%8s %10s %14s %16s\n", "format", "vertices", "upload (KiB)", "end_frame (ms)");
+    for (bool compact : {false, true}) {
+        StagingBelt belt(gpu.device);
+        ObjectRegistry registry(gpu.device);
+        ResourcePool pool(gpu.device);
+        FrameUniforms uniforms(pool);
+        ImGuiWebGPU imgui(gpu.device, belt, registry, pool, uniforms, nullptr, 13.0f, compact);
+        if (!imgui.wait_until_ready()) {
+            std::printf("UI pipeline creation failed\n");
+            return 1;
+        }
+        uint64_t upload_bytes = 0;
+        double end_frame_ms = 0.0;
+        int vertices = 0;
+        CompactVertexError error;
+        std::vector<CompactDrawVert> converted;
+
+        for (int frame = 0; frame < frames; frame++) {
+            uniforms.begin_frame(FrameUniforms::alignment);
+            imgui.begin_frame(frame % 2, width, height);
+            ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f));
+            ImGui::SetNextWindowSize(ImVec2(width, height));
+            ImGui::Begin("text", nullptr, ImGuiWindowFlags_NoDecoration);
+            for (int line = 0; line < line_count; line++) {
+                ImGui::Text("%05d The quick brown fox jumps over the lazy dog. 0123456789 %05d",
+                            frame + line, frame * line);
+            }
+            ImGui::End();
+
+            CommandEncoder encoder = gpu.device.CreateCommandEncoder();
+            auto start = std::chrono::steady_clock::now();
+            imgui.end_frame(target, encoder);
+            end_frame_ms +=
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+                    .count();
+            uniforms.end_frame(belt);
+            CommandBuffer commands[2] = {belt.finish(), encoder.Finish()};
+            gpu.device.GetQueue().Submit(2, commands);
+            belt.recall();
+            pool.submitted();
+            wait_for_queue(gpu);
+
+            upload_bytes += imgui.get_last_upload_bytes();
+            ImDrawData* draw_data = ImGui::GetDrawData();
+            vertices = draw_data->TotalVtxCount;
+            if (compact) {
+                // precision of what was uploaded against the float vertices
+                for (int n = 0; n < draw_data->CmdListsCount; n++) {
+                    ImVector<ImDrawVert> const& list = draw_data->CmdLists[n]->VtxBuffer;
+                    converted.resize(list.Size);
+                    convert_vertices(list.Data, converted.data(), list.Size);
+                    CompactVertexError list_error =
+                        compact_vertex_error(list.Data, converted.data(), list.Size);
+                    error.position = std::max(error.position, list_error.position);
+                    error.uv = std::max(error.uv, list_error.uv);
+                }
+            }
+        }
+
+        std::printf("%8s %10d %14.1f %16.3f\n", compact ? "compact" : "float", vertices,
+                    upload_bytes / 1024.0 / frames, end_frame_ms / frames);
+        if (compact) {
+            // rounding to nearest, with some slack for the float arithmetic of the check
+            float position_bound = 0.5f / compact_position_scale;
+            float uv_bound = 0.5f / 65535.0f;
+            std::printf("compact error: position %.4f px (bound %.4f), uv %.2e (bound %.2e)\n",
+                        error.position, position_bound, error.uv, uv_bound);
+            if (error.position > position_bound * 1.01f || error.uv > uv_bound * 1.01f) {
+                std::printf("compact error above the rounding bound\n");
+                result = 1;
+            }
+        }
+    }
+
+    target = nullptr;
+    gpu.release();
+    return result;
+}
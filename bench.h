@@ -0,0 +1,9 @@
+#pragma once
+
+// Renders an increasing number of views through a headless RenderService and prints the frame
+// time and the cost per view. Started with --bench-views.
+int run_view_benchmark(int max_views);
+
+// Draws a text heavy UI with the float and the compact vertex format and prints the uploaded bytes,
+// the end_frame() time and the compact format's largest error. Started with --bench-ui-vertices.
+int run_ui_vertex_benchmark(int frames);
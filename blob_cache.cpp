@@ -0,0 +1,220 @@
+#include "blob_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <vector>
+
+#include "file_cache.h"
+
+#ifndef DAWN_REVISION
+#define DAWN_REVISION "unknown"
+#endif
+
+namespace fs = std::filesystem;
+
+// Bumped when the entry layout changes: key size (uint64_t), key, value.
+static constexpr uint32_t entry_format = 1;
+
+static std::string hex(uint64_t value) {
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016" PRIx64, value);
+    return text;
+}
+
+BlobCachePlatform& BlobCachePlatform::instance() {
+    static BlobCachePlatform platform;
+    return platform;
+}
+
+// Other versions may belong to another adapter or build that still runs, so they are kept until
+// unused for this long, or until together they exceed the size limit of a store.
+static constexpr std::chrono::hours stale_version_age{24 * 30};
+
+static void remove_stale_versions(fs::path const& root, fs::path const& current, uint64_t max_bytes) {
+    struct Version {
+        fs::path path;
+        // hits touch their entries, see LoadData()
+        fs::file_time_type last_used;
+        uint64_t bytes = 0;
+    };
+    std::vector<Version> versions;
+    std::error_code error;
+    for (fs::directory_entry const& entry : fs::directory_iterator(root, error)) {
+        if (entry.path() == current || !entry.is_directory(error)) {
+            continue;
+        }
+        Version version{.path = entry.path(), .last_used = entry.last_write_time(error)};
+        for (fs::directory_entry const& file : fs::directory_iterator(entry.path(), error)) {
+            if (file.is_regular_file(error)) {
+                version.last_used = std::max(version.last_used, file.last_write_time(error));
+                version.bytes += file.file_size(error);
+            }
+        }
+        versions.push_back(version);
+    }
+
+    // most recently used first
+    std::sort(versions.begin(), versions.end(), [](Version const& a, Version const& b) {
+        return a.last_used > b.last_used;
+    });
+    fs::file_time_type now = fs::file_time_type::clock::now();
+    uint64_t kept_bytes = 0;
+    for (Version const& version : versions) {
+        kept_bytes += version.bytes;
+        if (now - version.last_used > stale_version_age || kept_bytes > max_bytes) {
+            fs::remove_all(version.path, error);
+        }
+    }
+}
+
+void BlobCache::open(wgpu::Adapter adapter, uint64_t max_bytes) {
+    wgpu::AdapterInfo info;
+    adapter.GetInfo(&info);
+    uint64_t version = hash_bytes(DAWN_REVISION, std::strlen(DAWN_REVISION));
+    version = hash_value(entry_format, version);
+    for (char const* text : {info.vendor, info.architecture, info.device, info.description}) {
+        version = hash_bytes(text, text ? std::strlen(text) : 0, version);
+    }
+    version = hash_value(info.backendType, version);
+    version = hash_value(info.vendorID, version);
+    version = hash_value(info.deviceID, version);
+
+    fs::path root = cache_directory() / "dawn";
+    fs::path directory = root / hex(version);
+    std::error_code error;
+    fs::create_directories(directory, error);
+    if (error) {
+        std::cout << "Blob cache disabled: " << error.message() << "\n";
+        return;
+    }
+    remove_stale_versions(root, directory, max_bytes);
+
+    uint64_t total_bytes = 0;
+    for (fs::directory_entry const& entry : fs::directory_iterator(directory, error)) {
+        if (entry.is_regular_file(error)) {
+            total_bytes += entry.file_size(error);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->directory = directory;
+    this->max_bytes = max_bytes;
+    this->stats.total_bytes = total_bytes;
+}
+
+fs::path BlobCache::entry_path(void const* key, size_t key_size) {
+    return this->directory / hex(hash_bytes(key, key_size));
+}
+
+size_t BlobCache::LoadData(void const* key, size_t key_size, void* value, size_t value_size) {
+    fs::path path;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (this->directory.empty()) {
+            return 0;
+        }
+        path = entry_path(key, key_size);
+    }
+
+    // Dawn asks for the size first, then for the data
+    MappedFile file(path);
+    uint64_t stored_key_size = 0;
+    size_t header_size = sizeof(stored_key_size) + key_size;
+    bool found = file.is_open() && file.get_size() >= header_size;
+    if (found) {
+        // hash collisions hold another key
+        memcpy(&stored_key_size, file.get_data(), sizeof(stored_key_size));
+        found = stored_key_size == key_size &&
+                memcmp(file.get_data() + sizeof(stored_key_size), key, key_size) == 0;
+    }
+    if (!found) {
+        if (!value) {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stats.misses++;
+        }
+        return 0;
+    }
+
+    size_t size = file.get_size() - header_size;
+    if (!value) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stats.hits++;
+        return size;
+    }
+    if (value_size < size) {
+        return 0;
+    }
+    memcpy(value, file.get_data() + header_size, size);
+    // eviction order
+    std::error_code error;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+    return size;
+}
+
+void BlobCache::StoreData(void const* key, size_t key_size, void const* value, size_t value_size) {
+    fs::path path;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (this->directory.empty()) {
+            return;
+        }
+        path = entry_path(key, key_size);
+    }
+
+    uint64_t stored_key_size = key_size;
+    std::vector<uint8_t> entry(sizeof(stored_key_size) + key_size + value_size);
+    memcpy(entry.data(), &stored_key_size, sizeof(stored_key_size));
+    memcpy(entry.data() + sizeof(stored_key_size), key, key_size);
+    memcpy(entry.data() + sizeof(stored_key_size) + key_size, value, value_size);
+
+    std::error_code error;
+    uint64_t replaced_size = fs::exists(path, error) ? fs::file_size(path, error) : 0;
+    if (error || !write_file_atomic(path, entry.data(), entry.size())) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stats.stores++;
+    this->stats.total_bytes -= std::min(replaced_size, this->stats.total_bytes);
+    this->stats.total_bytes += entry.size();
+    if (this->stats.total_bytes > this->max_bytes) {
+        evict();
+    }
+}
+
+void BlobCache::evict() {
+    std::error_code error;
+    std::vector<std::tuple<fs::file_time_type, uint64_t, fs::path>> entries;
+    for (fs::directory_entry const& entry : fs::directory_iterator(this->directory, error)) {
+        if (entry.is_regular_file(error)) {
+            entries.emplace_back(entry.last_write_time(error), entry.file_size(error), entry.path());
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+
+    uint64_t total_bytes = 0;
+    for (auto const& [time, size, path] : entries) {
+        total_bytes += size;
+    }
+    for (auto const& [time, size, path] : entries) {
+        if (total_bytes <= this->max_bytes / 4 * 3) {
+            break;
+        }
+        if (fs::remove(path, error)) {
+            total_bytes -= size;
+        }
+    }
+    this->stats.total_bytes = total_bytes;
+}
+
+BlobCache::Stats BlobCache::get_stats() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->stats;
+}
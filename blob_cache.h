@@ -0,0 +1,61 @@
+#pragma once
+
+#include <dawn/platform/DawnPlatform.h>
+#include <webgpu/webgpu_cpp.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+
+// Dawn's blob cache (translated shaders, driver pipeline caches) on disk, one file per entry under
+// cache_directory()/dawn/<version>. The version covers the adapter, its driver and the Dawn
+// revision; directories of other versions are removed once unused for 30 days or when together
+// they exceed the size limit, least recently used first. Least recently used entries are evicted
+// once the store grows beyond its size limit. Thread safe, Dawn may compile on several threads.
+class BlobCache : public dawn::platform::CachingInterface {
+public:
+    struct Stats {
+        uint32_t hits = 0;
+        uint32_t misses = 0;
+        uint32_t stores = 0;
+        uint64_t total_bytes = 0;
+    };
+
+    // Selects the store of adapter, before its device is created. Until then nothing is cached.
+    void open(wgpu::Adapter adapter, uint64_t max_bytes = 64 << 20);
+
+    size_t LoadData(void const* key, size_t key_size, void* value, size_t value_size) override;
+
+    void StoreData(void const* key, size_t key_size, void const* value, size_t value_size) override;
+
+    Stats get_stats();
+
+private:
+    std::filesystem::path entry_path(void const* key, size_t key_size);
+
+    // Removes the oldest entries until the store is below 3/4 of its limit. Mutex held.
+    void evict();
+
+    std::mutex mutex;
+    std::filesystem::path directory;
+    uint64_t max_bytes = 0;
+    Stats stats;
+};
+
+// Hands the blob cache to Dawn, through dawn::native::DawnInstanceDescriptor::platform.
+class BlobCachePlatform : public dawn::platform::Platform {
+public:
+    static BlobCachePlatform& instance();
+
+    BlobCache& get_cache() {
+        return this->cache;
+    }
+
+    dawn::platform::CachingInterface* GetCachingInterface() override {
+        return &this->cache;
+    }
+
+private:
+    BlobCache cache;
+};
@@ -0,0 +1,46 @@
+# Writes OUTPUT, a C++ source defining the EmbeddedShader NAME_shader (see shaders.h) from the WGSL
+# source WGSL and its SPIR-V translation SPIRV, if any. The SPIR-V is left out, with a warning,
+# when its header (see translate_shader.cmake) names another Dawn revision or WGSL source.
+if(NOT DAWN_REVISION)
+    set(DAWN_REVISION unknown)
+endif()
+file(READ "${WGSL}" wgsl_hex HEX)
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," wgsl_bytes "${wgsl_hex}")
+if(SPIRV)
+    set(spirv_revision "")
+    set(spirv_hash "")
+    if(EXISTS "${SPIRV}.header")
+        file(STRINGS "${SPIRV}.header" header)
+        list(GET header 0 spirv_revision)
+        list(GET header 1 spirv_hash)
+    endif()
+    file(SHA256 "${WGSL}" wgsl_hash)
+    if(NOT spirv_revision STREQUAL DAWN_REVISION OR NOT spirv_hash STREQUAL wgsl_hash)
+        message(WARNING "${SPIRV} was not translated from ${WGSL} by Dawn ${DAWN_REVISION}, "
+                        "embedding the WGSL only")
+        set(SPIRV "")
+    endif()
+endif()
+if(SPIRV)
+    file(READ "${SPIRV}" spirv_hex HEX)
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," spirv_bytes "${spirv_hex}")
+    set(spirv_definition "alignas(4) static unsigned char const spirv[] = {${spirv_bytes}};")
+    set(spirv_fields
+        "reinterpret_cast<uint32_t const*>(spirv),\n    sizeof(spirv) / 4,\n    \"${DAWN_REVISION}\",")
+else()
+    set(spirv_definition "")
+    set(spirv_fields "nullptr,\n    0,\n    nullptr,")
+endif()
+
+file(WRITE "${OUTPUT}" "// Generated from ${WGSL} by embed_shader.cmake, do not edit.
+#include \"shaders.h\"
+
+static unsigned char const wgsl[] = {${wgsl_bytes}0};
+${spirv_definition}
+
+EmbeddedShader const ${NAME}_shader = {
+    \"${NAME}\",
+    reinterpret_cast<char const*>(wgsl),
+    ${spirv_fields}
+};
+")
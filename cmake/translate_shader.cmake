@@ -0,0 +1,14 @@
+# Runs TINT on WGSL, writing FORMAT output to OUTPUT, and its header to OUTPUT.header: the Dawn
+# revision Tint was built from and the SHA-256 of WGSL, one per line. embed_shader.cmake checks
+# both before embedding the output.
+if(NOT DAWN_REVISION)
+    set(DAWN_REVISION unknown)
+endif()
+execute_process(COMMAND "${TINT}" --format ${FORMAT} -o "${OUTPUT}" "${WGSL}"
+                RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    file(REMOVE "${OUTPUT}" "${OUTPUT}.header")
+    message(FATAL_ERROR "Tint rejected ${WGSL}")
+endif()
+file(SHA256 "${WGSL}" wgsl_hash)
+file(WRITE "${OUTPUT}.header" "${DAWN_REVISION}\n${wgsl_hash}\n")
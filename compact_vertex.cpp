@@ -0,0 +1,74 @@
+#include "compact_vertex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define COMPACT_VERTEX_SSE2
+#endif
+
+static_assert(sizeof(ImDrawVert) == 20 && offsetof(ImDrawVert, uv) == 8 &&
+              offsetof(ImDrawVert, col) == 16);
+
+// UVs are biased by -32768 so both halves pack with signed saturation, the sign bit is flipped
+// back afterwards. Rounding is to nearest even in both paths, so they produce the same bits.
+static void convert_vertex(ImDrawVert const& src, CompactDrawVert& dst) {
+    auto pack = [](float value, float scale, float bias) {
+        long rounded = std::lrintf(value * scale + bias);
+        return static_cast<int16_t>(std::clamp(rounded, -32768l, 32767l));
+    };
+    dst.pos[0] = pack(src.pos.x, compact_position_scale, 0.0f);
+    dst.pos[1] = pack(src.pos.y, compact_position_scale, 0.0f);
+    dst.uv[0] = static_cast<uint16_t>(pack(src.uv.x, 65535.0f, -32768.0f)) ^ 0x8000;
+    dst.uv[1] = static_cast<uint16_t>(pack(src.uv.y, 65535.0f, -32768.0f)) ^ 0x8000;
+    dst.col = src.col;
+}
+
+void convert_vertices(ImDrawVert const* src, CompactDrawVert* dst, size_t count) {
+    size_t i = 0;
+#ifdef COMPACT_VERTEX_SSE2
+    __m128 const scale = _mm_setr_ps(compact_position_scale, compact_position_scale, 65535.0f,
+                                     65535.0f);
+    __m128 const bias = _mm_setr_ps(0.0f, 0.0f, -32768.0f, -32768.0f);
+    __m128 const low = _mm_set1_ps(-32768.0f);
+    __m128 const high = _mm_set1_ps(32767.0f);
+    __m128i const flip = _mm_setr_epi16(0, 0, -32768, -32768, 0, 0, -32768, -32768);
+    for (; i + 2 <= count; i += 2) {
+        // (pos.x, pos.y, uv.x, uv.y) of two vertices
+        __m128 a = _mm_loadu_ps(&src[i].pos.x);
+        __m128 b = _mm_loadu_ps(&src[i + 1].pos.x);
+        // clamp before converting, out of range floats would turn into INT_MIN
+        a = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(a, scale), bias), low), high);
+        b = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(b, scale), bias), low), high);
+        __m128i a_fixed = _mm_cvtps_epi32(a);
+        __m128i b_fixed = _mm_cvtps_epi32(b);
+        __m128i packed = _mm_xor_si128(_mm_packs_epi32(a_fixed, b_fixed), flip);
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(&dst[i]), packed);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(&dst[i + 1]),
+                         _mm_unpackhi_epi64(packed, packed));
+        dst[i].col = src[i].col;
+        dst[i + 1].col = src[i + 1].col;
+    }
+#endif
+    for (; i < count; i++) {
+        convert_vertex(src[i], dst[i]);
+    }
+}
+
+CompactVertexError compact_vertex_error(ImDrawVert const* src, CompactDrawVert const* dst,
+                                        size_t count) {
+    CompactVertexError error;
+    for (size_t i = 0; i < count; i++) {
+        for (int c = 0; c < 2; c++) {
+            float pos = c == 0 ? src[i].pos.x : src[i].pos.y;
+            float uv = c == 0 ? src[i].uv.x : src[i].uv.y;
+            error.position = std::max(error.position,
+                                      std::abs(dst[i].pos[c] / compact_position_scale - pos));
+            error.uv = std::max(error.uv, std::abs(dst[i].uv[c] / 65535.0f - uv));
+        }
+    }
+    return error;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <imgui/imgui.h>
+
+// 12 byte GPU vertex for the UI: screen position in 14.2 fixed point (VertexFormat::Sint16x2),
+// UV as VertexFormat::Unorm16x2 and the color as in ImDrawVert. ImDrawVert is 20 bytes.
+struct CompactDrawVert {
+    int16_t pos[2];
+    uint16_t uv[2];
+    uint32_t col;
+};
+static_assert(sizeof(CompactDrawVert) == 12);
+
+// Fixed point steps per pixel, positions cover -8192..8191 pixels.
+constexpr float compact_position_scale = 4.0f;
+
+// Largest display width and height whose positions all fit, in pixels.
+constexpr uint32_t compact_max_extent = 32767 / static_cast<uint32_t>(compact_position_scale);
+
+void convert_vertices(ImDrawVert const* src, CompactDrawVert* dst, size_t count);
+
+// Largest difference between src and the decoded dst, in pixels and in UV units. The rounding
+// bounds are 0.5 / compact_position_scale and 0.5 / 65535, positions outside the range clamp.
+struct CompactVertexError {
+    float position = 0.0f;
+    float uv = 0.0f;
+};
+
+CompactVertexError compact_vertex_error(ImDrawVert const* src, CompactDrawVert const* dst,
+                                        size_t count);
@@ -3121,6 +3121,8 @@ struct ImFontAtlas
     // [Internal] Font builder
     const ImFontBuilderIO*      FontBuilderIO;      // Opaque interface to a font builder (default to stb_truetype, can be changed to use FreeType by defining IMGUI_ENABLE_FREETYPE).
     unsigned int                FontBuilderFlags;   // Shared flags (for all fonts) for custom font builder. THIS IS BUILD IMPLEMENTATION DEPENDENT. Per-font override is also available in ImFontConfig.
+    void                      (*BuildParallelFor)(int count, void (*func)(int index, void* user_data), void* user_data, void* parallel_for_user_data); // Optional: run func(i, user_data) for i in [0, count) on any threads and return once all calls finished. Used by the stb_truetype builder to measure and rasterize glyphs in parallel. NULL = single threaded.
+    void*                       BuildParallelForUserData;
 
     // [Internal] Packing data
     int                         PackIdMouseCursors; // Custom texture rectangle ID for white pixel and mouse cursors
@@ -3159,6 +3161,8 @@ struct ImFont
     float                       Ascent, Descent;    // 4+4   // out //            // Ascent: distance from top to bottom of e.g. 'A' [0..FontSize]
     int                         MetricsTotalSurface;// 4     // out //            // Total surface in pixels to get an idea of the font rasterization/texture cost (not exact, we approximate the cost of padding between glyphs)
     ImU8                        Used4kPagesMap[(IM_UNICODE_CODEPOINT_MAX+1)/4096/8]; // 2 bytes if ImWchar=ImWchar16, 34 bytes if ImWchar==ImWchar32. Store 1-bit for each block of 4K codepoints that has one active glyph. This is mainly used to facilitate iterations across all used codepoints.
+    void                      (*MissingGlyphCallback)(const ImFont* font, ImWchar c, void* user_data); // in // = NULL // Called by FindGlyph() before falling back, e.g. to rasterize glyphs on demand.
+    void*                       MissingGlyphUserData; // in // = NULL
 
     // Methods
     IMGUI_API ImFont();
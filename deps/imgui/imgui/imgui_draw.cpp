@@ -130,8 +130,11 @@ namespace IMGUI_STB_NAMESPACE
 #ifdef  IMGUI_ENABLE_STB_TRUETYPE
 #ifndef STB_TRUETYPE_IMPLEMENTATION                         // in case the user already have an implementation in the _same_ compilation unit (e.g. unity builds)
 #ifndef IMGUI_DISABLE_STB_TRUETYPE_IMPLEMENTATION           // in case the user already have an implementation in another compilation unit
-#define STBTT_malloc(x,u)   ((void)(u), IM_ALLOC(x))
-#define STBTT_free(x,u)     ((void)(u), IM_FREE(x))
+// Glyphs may be rasterized on several threads (see ImFontAtlas::BuildParallelFor), so these skip the allocation statistics of the current context.
+static void*                ImStbTrueTypeAlloc(size_t size) { ImGuiMemAllocFunc alloc_func; ImGuiMemFreeFunc free_func; void* user_data; ImGui::GetAllocatorFunctions(&alloc_func, &free_func, &user_data); return alloc_func(size, user_data); }
+static void                 ImStbTrueTypeFree(void* ptr)    { ImGuiMemAllocFunc alloc_func; ImGuiMemFreeFunc free_func; void* user_data; ImGui::GetAllocatorFunctions(&alloc_func, &free_func, &user_data); free_func(ptr, user_data); }
+#define STBTT_malloc(x,u)   ((void)(u), ImStbTrueTypeAlloc(x))
+#define STBTT_free(x,u)     ((void)(u), ImStbTrueTypeFree(x))
 #define STBTT_assert(x)     do { IM_ASSERT(x); } while(0)
 #define STBTT_fmod(x,y)     ImFmod(x,y)
 #define STBTT_sqrt(x)       ImSqrt(x)
@@ -2741,6 +2744,79 @@ struct ImFontBuildDstData
     ImBitVector         GlyphsSet;          // This is used to resolve collision when multiple sources are merged into a same destination font.
 };
 
+// A run of consecutive glyphs of one source font, the unit of work for measuring and rasterizing in parallel.
+struct ImFontBuildGlyphChunk
+{
+    int                 SrcIndex;
+    int                 GlyphStart;
+    int                 GlyphCount;
+};
+
+struct ImFontBuildParallelData
+{
+    ImFontAtlas*                atlas;
+    ImFontBuildSrcData*         src_tmp_array;
+    const ImFontBuildGlyphChunk* chunks;
+    const stbtt_pack_context*   spc;
+};
+
+static void ImFontAtlasBuildParallelFor(ImFontAtlas* atlas, int count, void (*func)(int index, void* user_data), void* user_data)
+{
+    if (atlas->BuildParallelFor != NULL && count > 1)
+        atlas->BuildParallelFor(count, func, user_data, atlas->BuildParallelForUserData);
+    else
+        for (int i = 0; i < count; i++)
+            func(i, user_data);
+}
+
+// Gather the sizes of the rectangles we will need to pack (this loop is based on stbtt_PackFontRangesGatherRects)
+static void ImFontAtlasBuildMeasureGlyphChunk(int chunk_i, void* user_data)
+{
+    ImFontBuildParallelData* data = (ImFontBuildParallelData*)user_data;
+    const ImFontBuildGlyphChunk& chunk = data->chunks[chunk_i];
+    ImFontBuildSrcData& src_tmp = data->src_tmp_array[chunk.SrcIndex];
+    const ImFontConfig& cfg = data->atlas->ConfigData[chunk.SrcIndex];
+    const float scale = (cfg.SizePixels > 0.0f) ? stbtt_ScaleForPixelHeight(&src_tmp.FontInfo, cfg.SizePixels * cfg.RasterizerDensity) : stbtt_ScaleForMappingEmToPixels(&src_tmp.FontInfo, -cfg.SizePixels * cfg.RasterizerDensity);
+    const int padding = data->atlas->TexGlyphPadding;
+    for (int glyph_i = chunk.GlyphStart; glyph_i < chunk.GlyphStart + chunk.GlyphCount; glyph_i++)
+    {
+        int x0, y0, x1, y1;
+        const int glyph_index_in_font = stbtt_FindGlyphIndex(&src_tmp.FontInfo, src_tmp.GlyphsList[glyph_i]);
+        IM_ASSERT(glyph_index_in_font != 0);
+        stbtt_GetGlyphBitmapBoxSubpixel(&src_tmp.FontInfo, glyph_index_in_font, scale * cfg.OversampleH, scale * cfg.OversampleV, 0, 0, &x0, &y0, &x1, &y1);
+        src_tmp.Rects[glyph_i].w = (stbrp_coord)(x1 - x0 + padding + cfg.OversampleH - 1);
+        src_tmp.Rects[glyph_i].h = (stbrp_coord)(y1 - y0 + padding + cfg.OversampleV - 1);
+    }
+}
+
+// Rasterize packed glyphs. Chunks write to disjoint rectangles; stbtt_PackFontRangesRenderIntoRects() modifies the pack context so each call gets a copy.
+static void ImFontAtlasBuildRenderGlyphChunk(int chunk_i, void* user_data)
+{
+    ImFontBuildParallelData* data = (ImFontBuildParallelData*)user_data;
+    const ImFontBuildGlyphChunk& chunk = data->chunks[chunk_i];
+    ImFontBuildSrcData& src_tmp = data->src_tmp_array[chunk.SrcIndex];
+    const ImFontConfig& cfg = data->atlas->ConfigData[chunk.SrcIndex];
+
+    stbtt_pack_context spc = *data->spc;
+    stbtt_pack_range range = src_tmp.PackRange;
+    range.array_of_unicode_codepoints += chunk.GlyphStart;
+    range.chardata_for_range += chunk.GlyphStart;
+    range.num_chars = chunk.GlyphCount;
+    stbrp_rect* rects = src_tmp.Rects + chunk.GlyphStart;
+    stbtt_PackFontRangesRenderIntoRects(&spc, &src_tmp.FontInfo, &range, 1, rects);
+
+    // Apply multiply operator
+    if (cfg.RasterizerMultiply != 1.0f)
+    {
+        unsigned char multiply_table[256];
+        ImFontAtlasBuildMultiplyCalcLookupTable(multiply_table, cfg.RasterizerMultiply);
+        stbrp_rect* r = rects;
+        for (int glyph_i = 0; glyph_i < chunk.GlyphCount; glyph_i++, r++)
+            if (r->was_packed)
+                ImFontAtlasBuildMultiplyRectAlpha8(multiply_table, data->atlas->TexPixelsAlpha8, r->x, r->y, r->w, r->h, data->atlas->TexWidth * 1);
+    }
+}
+
 static void UnpackBitVectorToFlatIndexList(const ImBitVector* in, ImVector<int>* out)
 {
     IM_ASSERT(sizeof(in->Storage.Data[0]) == sizeof(int));
@@ -2864,6 +2940,9 @@ static bool ImFontAtlasBuildWithStbTruetype(ImFontAtlas* atlas)
     memset(buf_packedchars.Data, 0, (size_t)buf_packedchars.size_in_bytes());
 
     // 4. Gather glyphs sizes so we can pack them in our virtual canvas.
+    // Glyphs are measured and later rasterized in chunks, possibly in parallel. A font with fewer glyphs than a chunk (e.g. ASCII only) builds single threaded: a chunk is worth well over a thread wake-up.
+    const int GLYPH_CHUNK_SIZE = 128;
+    ImVector<ImFontBuildGlyphChunk> chunks;
     int total_surface = 0;
     int buf_rects_out_n = 0;
     int buf_packedchars_out_n = 0;
@@ -2888,20 +2967,16 @@ static bool ImFontAtlasBuildWithStbTruetype(ImFontAtlas* atlas)
         src_tmp.PackRange.h_oversample = (unsigned char)cfg.OversampleH;
         src_tmp.PackRange.v_oversample = (unsigned char)cfg.OversampleV;
 
-        // Gather the sizes of all rectangles we will need to pack (this loop is based on stbtt_PackFontRangesGatherRects)
-        const float scale = (cfg.SizePixels > 0.0f) ? stbtt_ScaleForPixelHeight(&src_tmp.FontInfo, cfg.SizePixels * cfg.RasterizerDensity) : stbtt_ScaleForMappingEmToPixels(&src_tmp.FontInfo, -cfg.SizePixels * cfg.RasterizerDensity);
-        const int padding = atlas->TexGlyphPadding;
-        for (int glyph_i = 0; glyph_i < src_tmp.GlyphsList.Size; glyph_i++)
+        for (int glyph_start = 0; glyph_start < src_tmp.GlyphsCount; glyph_start += GLYPH_CHUNK_SIZE)
         {
-            int x0, y0, x1, y1;
-            const int glyph_index_in_font = stbtt_FindGlyphIndex(&src_tmp.FontInfo, src_tmp.GlyphsList[glyph_i]);
-            IM_ASSERT(glyph_index_in_font != 0);
-            stbtt_GetGlyphBitmapBoxSubpixel(&src_tmp.FontInfo, glyph_index_in_font, scale * cfg.OversampleH, scale * cfg.OversampleV, 0, 0, &x0, &y0, &x1, &y1);
-            src_tmp.Rects[glyph_i].w = (stbrp_coord)(x1 - x0 + padding + cfg.OversampleH - 1);
-            src_tmp.Rects[glyph_i].h = (stbrp_coord)(y1 - y0 + padding + cfg.OversampleV - 1);
-            total_surface += src_tmp.Rects[glyph_i].w * src_tmp.Rects[glyph_i].h;
+            ImFontBuildGlyphChunk chunk = { src_i, glyph_start, ImMin(GLYPH_CHUNK_SIZE, src_tmp.GlyphsCount - glyph_start) };
+            chunks.push_back(chunk);
         }
     }
+    ImFontBuildParallelData parallel_data = { atlas, src_tmp_array.Data, chunks.Data, NULL };
+    ImFontAtlasBuildParallelFor(atlas, chunks.Size, ImFontAtlasBuildMeasureGlyphChunk, &parallel_data);
+    for (int rect_i = 0; rect_i < buf_rects.Size; rect_i++)
+        total_surface += buf_rects[rect_i].w * buf_rects[rect_i].h;
 
     // We need a width for the skyline algorithm, any width!
     // The exact width doesn't really matter much, but some API/GPU have texture size limitations and increasing width can decrease height.
@@ -2945,27 +3020,11 @@ static bool ImFontAtlasBuildWithStbTruetype(ImFontAtlas* atlas)
     spc.height = atlas->TexHeight;
 
     // 8. Render/rasterize font characters into the texture
+    parallel_data.spc = &spc;
+    ImFontAtlasBuildParallelFor(atlas, chunks.Size, ImFontAtlasBuildRenderGlyphChunk, &parallel_data);
     for (int src_i = 0; src_i < src_tmp_array.Size; src_i++)
-    {
-        ImFontConfig& cfg = atlas->ConfigData[src_i];
-        ImFontBuildSrcData& src_tmp = src_tmp_array[src_i];
-        if (src_tmp.GlyphsCount == 0)
-            continue;
-
-        stbtt_PackFontRangesRenderIntoRects(&spc, &src_tmp.FontInfo, &src_tmp.PackRange, 1, src_tmp.Rects);
-
-        // Apply multiply operator
-        if (cfg.RasterizerMultiply != 1.0f)
-        {
-            unsigned char multiply_table[256];
-            ImFontAtlasBuildMultiplyCalcLookupTable(multiply_table, cfg.RasterizerMultiply);
-            stbrp_rect* r = &src_tmp.Rects[0];
-            for (int glyph_i = 0; glyph_i < src_tmp.GlyphsCount; glyph_i++, r++)
-                if (r->was_packed)
-                    ImFontAtlasBuildMultiplyRectAlpha8(multiply_table, atlas->TexPixelsAlpha8, r->x, r->y, r->w, r->h, atlas->TexWidth * 1);
-        }
-        src_tmp.Rects = NULL;
-    }
+        src_tmp_array[src_i].Rects = NULL;
+    chunks.clear();
 
     // End packing
     stbtt_PackEnd(&spc);
@@ -3575,6 +3634,8 @@ ImFont::ImFont()
     Ascent = Descent = 0.0f;
     MetricsTotalSurface = 0;
     memset(Used4kPagesMap, 0, sizeof(Used4kPagesMap));
+    MissingGlyphCallback = NULL;
+    MissingGlyphUserData = NULL;
 }
 
 ImFont::~ImFont()
@@ -3780,11 +3841,13 @@ void ImFont::AddRemapChar(ImWchar dst, ImWchar src, bool overwrite_dst)
 
 const ImFontGlyph* ImFont::FindGlyph(ImWchar c) const
 {
-    if (c >= (size_t)IndexLookup.Size)
-        return FallbackGlyph;
-    const ImWchar i = IndexLookup.Data[c];
+    const ImWchar i = (c < (size_t)IndexLookup.Size) ? IndexLookup.Data[c] : (ImWchar)-1;
     if (i == (ImWchar)-1)
+    {
+        if (MissingGlyphCallback)
+            MissingGlyphCallback(this, c, MissingGlyphUserData);
         return FallbackGlyph;
+    }
     return &Glyphs.Data[i];
 }
 
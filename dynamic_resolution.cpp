@@ -0,0 +1,36 @@
+#include "dynamic_resolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+DynamicResolution::DynamicResolution(double budget_ms, float min_scale, float max_scale)
+: budget_ms(budget_ms), min_scale(min_scale), max_scale(max_scale), scale(max_scale) {}
+
+float DynamicResolution::update(double gpu_frame_ms) {
+    if (gpu_frame_ms <= 0.0) {
+        return this->scale;
+    }
+
+    this->smoothed_ms = (this->smoothed_ms < 0.0)
+                            ? gpu_frame_ms
+                            : 0.9 * this->smoothed_ms + 0.1 * gpu_frame_ms;
+
+    // Only react outside of a dead band around the budget. Growing is slower than shrinking so
+    // that a missed budget is corrected quickly while recovery doesn't overshoot.
+    double ratio = this->budget_ms / this->smoothed_ms;
+    double step = 1.0;
+    if (ratio < 1.0) {
+        step = std::max(std::sqrt(ratio), 0.9);
+    } else if (ratio > 1.2) {
+        step = std::min(std::sqrt(ratio), 1.02);
+    }
+
+    // Quantize to 1/64 so that tiny changes don't reallocate or resize anything.
+    float target = std::clamp(float(this->scale * step), this->min_scale, this->max_scale);
+    this->scale = std::round(target * 64.0f) / 64.0f;
+    return this->scale;
+}
+
+uint32_t DynamicResolution::scaled(uint32_t size) const {
+    return std::max<uint32_t>(1, static_cast<uint32_t>(std::lround(size * this->scale)));
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+// Picks the render scale that keeps the measured GPU frame time within a budget. The GPU cost is
+// assumed proportional to the pixel count, i.e. to the square of the scale; measurements are
+// smoothed and steps are limited so the resolution doesn't oscillate.
+class DynamicResolution {
+public:
+    DynamicResolution(double budget_ms = 8.0, float min_scale = 0.5f, float max_scale = 1.0f);
+
+    void set_budget_ms(double budget_ms) {
+        this->budget_ms = budget_ms;
+    }
+
+    // Feeds one GPU frame time measurement and returns the scale to render the next frame with.
+    float update(double gpu_frame_ms);
+
+    float get_scale() const {
+        return this->scale;
+    }
+
+    // Scaled size of a dimension, never below one pixel.
+    uint32_t scaled(uint32_t size) const;
+
+private:
+    double budget_ms;
+    float min_scale;
+    float max_scale;
+    float scale;
+    double smoothed_ms = -1.0;
+};
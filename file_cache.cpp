@@ -0,0 +1,129 @@
+#include "file_cache.h"
+
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <system_error>
+#include <thread>
+
+#ifdef _WIN32
+#include <process.h>
+#include <vector>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+fs::path cache_directory() {
+    static fs::path const directory = [] {
+        fs::path base;
+        if (char const* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+            base = xdg;
+        } else if (char const* home = std::getenv("HOME"); home && *home) {
+            base = fs::path(home) / ".cache";
+        } else {
+            base = fs::temp_directory_path();
+        }
+        fs::path path = base / "webgpu-qt-test";
+        std::error_code error;
+        fs::create_directories(path, error);
+        return path;
+    }();
+    return directory;
+}
+
+uint64_t hash_bytes(void const* data, size_t size, uint64_t seed) {
+    uint8_t const* bytes = static_cast<uint8_t const*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+bool write_file_atomic(fs::path const& path, void const* data, size_t size) {
+    // Unique per process, thread and call: concurrent writers of the same path each rename a
+    // complete file of their own.
+    static std::atomic<uint64_t> counter = 0;
+#ifdef _WIN32
+    int pid = _getpid();
+#else
+    int pid = getpid();
+#endif
+    char suffix[64];
+    std::snprintf(suffix, sizeof(suffix), ".%d.%zx.%" PRIu64 ".tmp", pid,
+                  std::hash<std::thread::id>()(std::this_thread::get_id()), counter++);
+    fs::path temp_path = path;
+    temp_path += suffix;
+
+    std::error_code error;
+    bool written;
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        written = static_cast<bool>(file.write(static_cast<char const*>(data), size));
+    }
+    if (written) {
+        fs::rename(temp_path, path, error);
+    }
+    if (!written || error) {
+        fs::remove(temp_path, error);
+        return false;
+    }
+    return true;
+}
+
+#ifdef _WIN32
+
+// No mmap, the file is read into memory instead.
+MappedFile::MappedFile(fs::path const& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return;
+    }
+    this->size = file.tellg();
+    uint8_t* buffer = new uint8_t[this->size];
+    file.seekg(0);
+    if (this->size == 0 || !file.read(reinterpret_cast<char*>(buffer), this->size)) {
+        delete[] buffer;
+        this->size = 0;
+        return;
+    }
+    this->data = buffer;
+}
+
+MappedFile::~MappedFile() {
+    delete[] this->data;
+}
+
+#else
+
+MappedFile::MappedFile(fs::path const& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            this->data = static_cast<uint8_t const*>(mapping);
+            this->size = info.st_size;
+        }
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (this->data) {
+        munmap(const_cast<uint8_t*>(this->data), this->size);
+    }
+}
+
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// Directory for data that is expensive to generate and safe to lose: $XDG_CACHE_HOME/webgpu-qt-test,
+// falling back to ~/.cache and the temp directory. Created on first use.
+std::filesystem::path cache_directory();
+
+// FNV-1a, for cache keys. Chain calls by passing the previous result as seed.
+uint64_t hash_bytes(void const* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull);
+
+template <typename T>
+uint64_t hash_value(T const& value, uint64_t seed = 0xcbf29ce484222325ull) {
+    return hash_bytes(&value, sizeof(T), seed);
+}
+
+// Writes to a temporary file next to path and renames it, so readers never see partial files.
+bool write_file_atomic(std::filesystem::path const& path, void const* data, size_t size);
+
+// Read only memory mapping of a whole file.
+class MappedFile {
+public:
+    explicit MappedFile(std::filesystem::path const& path);
+
+    ~MappedFile();
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    bool is_open() const {
+        return this->data != nullptr;
+    }
+
+    uint8_t const* get_data() const {
+        return this->data;
+    }
+
+    size_t get_size() const {
+        return this->size;
+    }
+
+private:
+    uint8_t const* data = nullptr;
+    size_t size = 0;
+};
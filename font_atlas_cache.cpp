@@ -0,0 +1,204 @@
+#include "font_atlas_cache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <imgui/imgui_internal.h>
+
+#include "file_cache.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr uint32_t cache_magic = 0x41464d49;  // "IMFA"
+constexpr uint32_t cache_version = 1;
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    int32_t tex_width;
+    int32_t tex_height;
+    int32_t font_count;
+    int32_t custom_rect_count;
+};
+
+struct FontHeader {
+    float ascent;
+    float descent;
+    int32_t metrics_total_surface;
+    int32_t glyph_count;
+};
+
+struct RectPosition {
+    uint16_t x;
+    uint16_t y;
+};
+
+// Sequential reads from the mapping, which gives no alignment guarantees for the structs.
+struct Reader {
+    uint8_t const* data;
+    size_t size;
+    size_t offset = 0;
+
+    bool read(void* out, size_t count) {
+        if (count > this->size - this->offset) {
+            return false;
+        }
+        memcpy(out, this->data + this->offset, count);
+        this->offset += count;
+        return true;
+    }
+};
+
+template <typename T>
+void append(std::vector<uint8_t>& out, T const* data, size_t count = 1) {
+    uint8_t const* bytes = reinterpret_cast<uint8_t const*>(data);
+    out.insert(out.end(), bytes, bytes + count * sizeof(T));
+}
+
+}  // namespace
+
+fs::path font_atlas_cache_path(ImFontAtlas const* atlas) {
+    uint64_t key = hash_value(IMGUI_VERSION_NUM);
+    key = hash_value(sizeof(ImFontGlyph), key);
+    key = hash_value(atlas->Flags, key);
+    key = hash_value(atlas->TexDesiredWidth, key);
+    key = hash_value(atlas->TexGlyphPadding, key);
+    for (ImFontConfig const& config : atlas->ConfigData) {
+        key = hash_bytes(config.FontData, config.FontDataSize, key);
+        key = hash_value(config.FontNo, key);
+        key = hash_value(config.SizePixels, key);
+        key = hash_value(config.OversampleH, key);
+        key = hash_value(config.OversampleV, key);
+        key = hash_value(config.PixelSnapH, key);
+        key = hash_value(config.GlyphExtraSpacing, key);
+        key = hash_value(config.GlyphOffset, key);
+        key = hash_value(config.GlyphMinAdvanceX, key);
+        key = hash_value(config.GlyphMaxAdvanceX, key);
+        key = hash_value(config.MergeMode, key);
+        key = hash_value(config.FontBuilderFlags, key);
+        key = hash_value(config.RasterizerMultiply, key);
+        key = hash_value(config.RasterizerDensity, key);
+        key = hash_value(config.EllipsisChar, key);
+        // null ranges stand for the default ranges
+        size_t range_count = 0;
+        while (config.GlyphRanges && config.GlyphRanges[range_count]) {
+            range_count++;
+        }
+        key = hash_bytes(config.GlyphRanges, range_count * sizeof(ImWchar), key);
+    }
+
+    char name[40];
+    snprintf(name, sizeof(name), "font_atlas_%016llx.bin", static_cast<unsigned long long>(key));
+    return cache_directory() / name;
+}
+
+bool load_font_atlas(ImFontAtlas* atlas, fs::path const& path) {
+    MappedFile file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    Reader reader{file.get_data(), file.get_size()};
+
+    // The rectangles for mouse cursors and lines are registered as by Build(), only their packed
+    // positions come from the cache.
+    ImFontAtlasBuildInit(atlas);
+
+    CacheHeader header;
+    if (!reader.read(&header, sizeof(header)) || header.magic != cache_magic ||
+        header.version != cache_version || header.font_count != atlas->Fonts.Size ||
+        header.custom_rect_count != atlas->CustomRects.Size || header.tex_width <= 0 ||
+        header.tex_height <= 0) {
+        return false;
+    }
+
+    std::vector<FontHeader> fonts(header.font_count);
+    std::vector<std::vector<ImFontGlyph>> glyphs(header.font_count);
+    for (int i = 0; i < header.font_count; i++) {
+        if (!reader.read(&fonts[i], sizeof(FontHeader)) || fonts[i].glyph_count < 0) {
+            return false;
+        }
+        glyphs[i].resize(fonts[i].glyph_count);
+        if (!reader.read(glyphs[i].data(), glyphs[i].size() * sizeof(ImFontGlyph))) {
+            return false;
+        }
+    }
+    std::vector<RectPosition> rects(header.custom_rect_count);
+    if (!reader.read(rects.data(), rects.size() * sizeof(RectPosition))) {
+        return false;
+    }
+    size_t pixel_count = static_cast<size_t>(header.tex_width) * header.tex_height;
+    if (reader.size - reader.offset != pixel_count) {
+        return false;
+    }
+
+    atlas->ClearTexData();
+    atlas->TexWidth = header.tex_width;
+    atlas->TexHeight = header.tex_height;
+    atlas->TexUvScale = ImVec2(1.0f / header.tex_width, 1.0f / header.tex_height);
+    atlas->TexPixelsAlpha8 = static_cast<unsigned char*>(IM_ALLOC(pixel_count));
+    reader.read(atlas->TexPixelsAlpha8, pixel_count);
+
+    for (int i = 0; i < header.custom_rect_count; i++) {
+        atlas->CustomRects[i].X = rects[i].x;
+        atlas->CustomRects[i].Y = rects[i].y;
+    }
+
+    ImFontAtlasUpdateConfigDataPointers(atlas);
+    for (int i = 0; i < header.font_count; i++) {
+        ImFont* font = atlas->Fonts[i];
+        ImFontAtlasBuildSetupFont(atlas, font, const_cast<ImFontConfig*>(font->ConfigData),
+                                  fonts[i].ascent, fonts[i].descent);
+        font->Glyphs.resize(fonts[i].glyph_count);
+        memcpy(font->Glyphs.Data, glyphs[i].data(), glyphs[i].size() * sizeof(ImFontGlyph));
+        font->MetricsTotalSurface = fonts[i].metrics_total_surface;
+        font->DirtyLookupTables = true;
+    }
+
+    // white pixel and line UVs, lookup tables
+    ImFontAtlasBuildFinish(atlas);
+    return true;
+}
+
+bool save_font_atlas(ImFontAtlas const* atlas, fs::path const& path) {
+    if (!atlas->TexPixelsAlpha8 || !atlas->IsBuilt()) {
+        return false;
+    }
+    for (ImFontAtlasCustomRect const& rect : atlas->CustomRects) {
+        if (rect.Font) {
+            // custom glyphs would have to be added back to their font, not supported
+            return false;
+        }
+    }
+
+    std::vector<uint8_t> out;
+    CacheHeader header{
+        .magic = cache_magic,
+        .version = cache_version,
+        .tex_width = atlas->TexWidth,
+        .tex_height = atlas->TexHeight,
+        .font_count = atlas->Fonts.Size,
+        .custom_rect_count = atlas->CustomRects.Size,
+    };
+    append(out, &header);
+    for (ImFont const* font : atlas->Fonts) {
+        FontHeader font_header{
+            .ascent = font->Ascent,
+            .descent = font->Descent,
+            .metrics_total_surface = font->MetricsTotalSurface,
+            .glyph_count = font->Glyphs.Size,
+        };
+        append(out, &font_header);
+        append(out, font->Glyphs.Data, font->Glyphs.Size);
+    }
+    for (ImFontAtlasCustomRect const& rect : atlas->CustomRects) {
+        RectPosition position{rect.X, rect.Y};
+        append(out, &position);
+    }
+    append(out, atlas->TexPixelsAlpha8, static_cast<size_t>(atlas->TexWidth) * atlas->TexHeight);
+
+    return write_file_atomic(path, out.data(), out.size());
+}
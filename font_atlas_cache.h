@@ -0,0 +1,17 @@
+#pragma once
+
+#include <filesystem>
+
+#include <imgui/imgui.h>
+
+// On-disk cache of a baked ImFontAtlas: the alpha pixels plus the metrics and glyphs of every
+// font. The file name is derived from the font data, sizes, glyph ranges and rasterizer settings
+// of all fonts added so far, so any change to them misses the cache.
+std::filesystem::path font_atlas_cache_path(ImFontAtlas const* atlas);
+
+// Restores the atlas as Build() would have left it, with the pixels in TexPixelsAlpha8. Fonts
+// must already be added. Returns false if the file is missing or doesn't match.
+bool load_font_atlas(ImFontAtlas* atlas, std::filesystem::path const& path);
+
+// Call right after Build(), before anything modifies the atlas.
+bool save_font_atlas(ImFontAtlas const* atlas, std::filesystem::path const& path);
@@ -0,0 +1,60 @@
+#include "frame_scheduler.h"
+
+#include <algorithm>
+#include <cassert>
+
+FrameScheduler::FrameScheduler(double target_fps, double idle_fps)
+: target_interval(interval_for(target_fps)),
+  idle_interval(interval_for(idle_fps)),
+  frame_start(Clock::now()) {}
+
+FrameScheduler::Clock::duration FrameScheduler::interval_for(double fps) {
+    assert(fps > 0.0);
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps));
+}
+
+void FrameScheduler::set_target_fps(double fps) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->target_interval = interval_for(fps);
+}
+
+void FrameScheduler::set_idle_fps(double fps) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->idle_interval = interval_for(fps);
+}
+
+void FrameScheduler::wake() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->woken = true;
+    }
+    this->condition.notify_one();
+}
+
+void FrameScheduler::stop() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopped = true;
+    }
+    this->condition.notify_one();
+}
+
+void FrameScheduler::wait_for_next_frame(bool idle) {
+    std::unique_lock<std::mutex> lock(this->mutex);
+
+    Clock::time_point target_deadline = this->frame_start + this->target_interval;
+    Clock::time_point deadline =
+        (idle && !this->woken) ? this->frame_start + this->idle_interval : target_deadline;
+
+    while (!this->stopped && Clock::now() < deadline) {
+        this->condition.wait_until(lock, deadline);
+        if (this->woken) {
+            deadline = std::min(deadline, target_deadline);
+        }
+    }
+    this->woken = false;
+
+    // Keep the cadence steady, but don't try to catch up after falling more than a frame behind.
+    Clock::time_point now = Clock::now();
+    this->frame_start = (now - deadline < this->target_interval) ? deadline : now;
+}
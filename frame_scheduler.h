@@ -0,0 +1,40 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+// Paces a render loop. Frames start on a fixed cadence derived from the target rate; the thread
+// sleeps until the next deadline instead of spinning. While idle the cadence drops to the idle
+// rate, and wake() cuts an idle sleep short so the next frame starts as soon as the target rate
+// allows.
+class FrameScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    FrameScheduler(double target_fps = 60.0, double idle_fps = 4.0);
+
+    void set_target_fps(double fps);
+
+    void set_idle_fps(double fps);
+
+    // Thread safe. Signals new input or content; the next frame is paced at the target rate.
+    void wake();
+
+    // Thread safe. Makes the current and all later waits return immediately.
+    void stop();
+
+    // Blocks until the next frame is due.
+    void wait_for_next_frame(bool idle);
+
+private:
+    static Clock::duration interval_for(double fps);
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    Clock::duration target_interval;
+    Clock::duration idle_interval;
+    Clock::time_point frame_start;
+    bool woken = false;
+    bool stopped = false;
+};
@@ -0,0 +1,41 @@
+#include "frame_uniforms.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "webgpu_helpers.h"
+
+using namespace wgpu;
+
+void FrameUniforms::begin_frame(uint64_t size) {
+    this->used = 0;
+    size = align_up(std::max<uint64_t>(size, alignment), alignment);
+    if (this->buffer && this->buffer.GetSize() >= size) {
+        return;
+    }
+    this->pool->release(this->buffer);
+    this->buffer =
+        this->pool->acquire_buffer(BufferUsage::Uniform | BufferUsage::CopyDst, size, "frame uniforms");
+    this->data.resize(this->buffer.GetSize());
+}
+
+uint32_t FrameUniforms::allocate(void const* data, uint64_t size) {
+    uint64_t offset = this->used;
+    // sized by begin_frame(), bind groups made this frame can't follow a new buffer
+    if (offset + size > this->data.size()) {
+        std::cout << "Frame uniforms overflow: " << offset + size << " bytes, begin_frame() reserved "
+                  << this->data.size() << "\n";
+        std::abort();
+    }
+    memcpy(this->data.data() + offset, data, size);
+    this->used = align_up(offset + size, alignment);
+    return static_cast<uint32_t>(offset);
+}
+
+void FrameUniforms::end_frame(StagingBelt& belt) {
+    if (this->used > 0) {
+        belt.write_buffer(this->buffer, 0, this->data.data(), this->used);
+    }
+}
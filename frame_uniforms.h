@@ -0,0 +1,48 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "resource_pool.h"
+#include "staging_belt.h"
+
+// The constants of every pass of a frame, packed into one uniform buffer at 256 byte aligned
+// offsets and bound through dynamic offsets, so that a frame costs one upload and no new buffers
+// or bind groups. Queue order lets each frame start over at offset 0: its upload executes after
+// the previous frame's passes have read their constants.
+class FrameUniforms {
+public:
+    // minUniformBufferOffsetAlignment of the default limits
+    static constexpr uint64_t alignment = 256;
+
+    explicit FrameUniforms(ResourcePool& pool) : pool(&pool) {}
+
+    // Starts the frame with room for at least size bytes. Call before anything is bound: growing
+    // replaces the buffer, bind groups made on the previous one have to be recreated.
+    void begin_frame(uint64_t size);
+
+    // Copies size bytes into the frame's constants and returns their dynamic offset. Aborts when
+    // the frame needs more than begin_frame() reserved, in every build type.
+    uint32_t allocate(void const* data, uint64_t size);
+
+    template <typename T>
+    uint32_t allocate(T const& value) {
+        return allocate(&value, sizeof(T));
+    }
+
+    // Stages the frame's constants with one copy, before the belt is finished.
+    void end_frame(StagingBelt& belt);
+
+    wgpu::Buffer get_buffer() const {
+        return this->buffer;
+    }
+
+private:
+    ResourcePool* pool;
+    wgpu::Buffer buffer;
+    // CPU copy of the frame, capacity is kept across frames
+    std::vector<uint8_t> data;
+    uint64_t used = 0;
+};
@@ -0,0 +1,296 @@
+#include "gl_shared_frames.h"
+
+// Qt's X11 headers don't mix with Xlib's
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QQuickWindow>
+#include <QSGTexture>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+
+// GL_OES_EGL_image
+using GLEGLImageTargetTexture2DOES = void (*)(GLenum target, void *image);
+
+static constexpr uint64_t drm_format_mod_invalid = 0x00ffffffffffffffull;
+
+// The EGL display the scene graph renders on and its extensions, resolved with the first import.
+struct EGLInterop {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    // EGL_EXT_image_dma_buf_import_modifiers, tiled buffers import without it only by luck
+    bool modifiers = false;
+    // EGL_ANDROID_native_fence_sync, without it the fences are waited for on the CPU
+    bool native_fences = false;
+    PFNEGLCREATEIMAGEKHRPROC create_image = nullptr;
+    PFNEGLDESTROYIMAGEKHRPROC destroy_image = nullptr;
+    GLEGLImageTargetTexture2DOES image_target_texture = nullptr;
+    PFNEGLCREATESYNCKHRPROC create_sync = nullptr;
+    PFNEGLDESTROYSYNCKHRPROC destroy_sync = nullptr;
+    PFNEGLWAITSYNCKHRPROC wait_sync = nullptr;
+    PFNEGLDUPNATIVEFENCEFDANDROIDPROC dup_native_fence = nullptr;
+};
+
+static bool has_extension(char const *extensions, char const *name) {
+    size_t length = std::strlen(name);
+    for (char const *found = extensions; found && (found = std::strstr(found, name));
+         found += length) {
+        bool starts = found == extensions || found[-1] == ' ';
+        bool ends = found[length] == ' ' || found[length] == '\0';
+        if (starts && ends) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Null when buffers can't be imported, the reason is printed once. Context current.
+static EGLInterop const *egl_interop() {
+    static EGLInterop interop = [] {
+        EGLInterop interop;
+        interop.display = eglGetCurrentDisplay();
+        if (interop.display == EGL_NO_DISPLAY) {
+            std::cout << "Views can't be shown: the scene graph doesn't render through EGL, set "
+                         "QT_XCB_GL_INTEGRATION=xcb_egl\n";
+            return interop;
+        }
+        char const *extensions = eglQueryString(interop.display, EGL_EXTENSIONS);
+        if (!has_extension(extensions, "EGL_EXT_image_dma_buf_import") ||
+            !QOpenGLContext::currentContext()->hasExtension("GL_OES_EGL_image")) {
+            std::cout << "Views can't be shown: no EGL dma-buf import\n";
+            return interop;
+        }
+        interop.modifiers = has_extension(extensions, "EGL_EXT_image_dma_buf_import_modifiers");
+        interop.native_fences = has_extension(extensions, "EGL_ANDROID_native_fence_sync") &&
+                                has_extension(extensions, "EGL_KHR_wait_sync");
+        interop.destroy_image = reinterpret_cast<PFNEGLDESTROYIMAGEKHRPROC>(
+            eglGetProcAddress("eglDestroyImageKHR"));
+        interop.image_target_texture = reinterpret_cast<GLEGLImageTargetTexture2DOES>(
+            eglGetProcAddress("glEGLImageTargetTexture2DOES"));
+        if (interop.native_fences) {
+            interop.create_sync = reinterpret_cast<PFNEGLCREATESYNCKHRPROC>(
+                eglGetProcAddress("eglCreateSyncKHR"));
+            interop.destroy_sync = reinterpret_cast<PFNEGLDESTROYSYNCKHRPROC>(
+                eglGetProcAddress("eglDestroySyncKHR"));
+            interop.wait_sync = reinterpret_cast<PFNEGLWAITSYNCKHRPROC>(
+                eglGetProcAddress("eglWaitSyncKHR"));
+            interop.dup_native_fence = reinterpret_cast<PFNEGLDUPNATIVEFENCEFDANDROIDPROC>(
+                eglGetProcAddress("eglDupNativeFenceFDANDROID"));
+        }
+        // set last, it marks the import as supported
+        interop.create_image = reinterpret_cast<PFNEGLCREATEIMAGEKHRPROC>(
+            eglGetProcAddress("eglCreateImageKHR"));
+        return interop;
+    }();
+    return interop.create_image ? &interop : nullptr;
+}
+
+GLSharedFrames::GLSharedFrames(RenderService &service, ViewId view)
+    : m_service(service), m_view(view) {
+}
+
+GLSharedFrames::~GLSharedFrames() {
+    for (Buffer &buffer : m_buffers) {
+        // wraps without owning the GL texture
+        delete buffer.sceneGraphTexture;
+        close(buffer.buffer.fd);
+    }
+    if (m_hasPending) {
+        m_service.release_frame(m_view, m_pending.buffer.id, m_pending.fence_fd);
+    }
+    if (m_shownId != 0) {
+        m_service.release_frame(m_view, m_shownId, -1);
+    }
+}
+
+void GLSharedFrames::receive(SharedFrame const &frame) {
+    QMutexLocker lock(&m_mutex);
+    if (!find(frame.buffer.id)) {
+        // the frame's fd is only valid during the callback
+        Buffer buffer{.buffer = frame.buffer};
+        buffer.buffer.fd = dup(frame.buffer.fd);
+        m_buffers.push_back(buffer);
+    }
+    if (m_hasPending) {
+        m_service.release_frame(m_view, m_pending.buffer.id, m_pending.fence_fd);
+    }
+    m_pending = frame;
+    m_hasPending = true;
+}
+
+bool GLSharedFrames::update() {
+    QMutexLocker lock(&m_mutex);
+    if (!m_hasPending) {
+        return false;
+    }
+    SharedFrame frame = m_pending;
+    m_hasPending = false;
+    Buffer *buffer = find(frame.buffer.id);
+    if (!buffer->texture && (buffer->failed || !import(*buffer))) {
+        buffer->failed = true;
+        m_service.release_frame(m_view, frame.buffer.id, frame.fence_fd);
+        return false;
+    }
+
+    // the GPU waits for the rendering before sampling, not this thread
+    wait(frame.fence_fd);
+    if (m_shownId != 0) {
+        m_service.release_frame(m_view, m_shownId, signal());
+    }
+    m_shownId = frame.buffer.id;
+    m_shownTexture = buffer->texture;
+    m_shownTextureSize = QSize(frame.buffer.width, frame.buffer.height);
+    m_shownSize = QSize(frame.width, frame.height);
+
+    // the view recreated its targets, the older ones don't come back
+    for (auto it = m_buffers.begin(); it != m_buffers.end();) {
+        if (it->buffer.generation != frame.buffer.generation) {
+            unimport(*it);
+            close(it->buffer.fd);
+            it = m_buffers.erase(it);
+        } else {
+            it++;
+        }
+    }
+    return true;
+}
+
+void GLSharedFrames::release() {
+    QMutexLocker lock(&m_mutex);
+    for (Buffer &buffer : m_buffers) {
+        unimport(buffer);
+    }
+    if (m_shownId != 0) {
+        m_service.release_frame(m_view, m_shownId, signal());
+    }
+    m_shownId = 0;
+    m_shownTexture = 0;
+    m_shownTextureSize = QSize();
+    m_shownSize = QSize();
+}
+
+QSGTexture *GLSharedFrames::sceneGraphTexture(QQuickWindow *window) {
+    QMutexLocker lock(&m_mutex);
+    Buffer *buffer = find(m_shownId);
+    if (!buffer) {
+        return nullptr;
+    }
+    if (!buffer->sceneGraphTexture) {
+        buffer->sceneGraphTexture = window->createTextureFromNativeObject(
+            QQuickWindow::NativeObjectTexture, &buffer->texture, 0, m_shownTextureSize,
+            QQuickWindow::TextureHasAlphaChannel);
+        buffer->sceneGraphTexture->setFiltering(QSGTexture::Linear);
+    }
+    return buffer->sceneGraphTexture;
+}
+
+GLSharedFrames::Buffer *GLSharedFrames::find(uint32_t id) {
+    for (Buffer &buffer : m_buffers) {
+        if (buffer.buffer.id == id) {
+            return &buffer;
+        }
+    }
+    return nullptr;
+}
+
+bool GLSharedFrames::import(Buffer &buffer) {
+    EGLInterop const *egl = egl_interop();
+    if (!egl) {
+        return false;
+    }
+    SharedBuffer const &shared = buffer.buffer;
+    EGLint attribs[] = {
+        EGL_WIDTH, EGLint(shared.width),
+        EGL_HEIGHT, EGLint(shared.height),
+        EGL_LINUX_DRM_FOURCC_EXT, EGLint(shared.drm_format),
+        EGL_DMA_BUF_PLANE0_FD_EXT, shared.fd,
+        EGL_DMA_BUF_PLANE0_OFFSET_EXT, EGLint(shared.offset),
+        EGL_DMA_BUF_PLANE0_PITCH_EXT, EGLint(shared.stride),
+        EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT, EGLint(shared.drm_modifier & 0xffffffff),
+        EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT, EGLint(shared.drm_modifier >> 32),
+        EGL_NONE,
+    };
+    if (!egl->modifiers || shared.drm_modifier == drm_format_mod_invalid) {
+        // the driver's implicit layout
+        attribs[12] = EGL_NONE;
+    }
+    EGLImageKHR image = egl->create_image(egl->display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT,
+                                          nullptr, attribs);
+    if (image == EGL_NO_IMAGE_KHR) {
+        std::cout << "View buffer import failed: EGL error 0x" << std::hex << eglGetError()
+                  << std::dec << "\n";
+        return false;
+    }
+
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    gl->glGenTextures(1, &buffer.texture);
+    gl->glBindTexture(GL_TEXTURE_2D, buffer.texture);
+    egl->image_target_texture(GL_TEXTURE_2D, image);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    gl->glBindTexture(GL_TEXTURE_2D, 0);
+    buffer.image = image;
+    return true;
+}
+
+void GLSharedFrames::unimport(Buffer &buffer) {
+    delete buffer.sceneGraphTexture;
+    buffer.sceneGraphTexture = nullptr;
+    if (buffer.texture) {
+        QOpenGLContext::currentContext()->functions()->glDeleteTextures(1, &buffer.texture);
+        buffer.texture = 0;
+    }
+    if (buffer.image) {
+        EGLInterop const *egl = egl_interop();
+        egl->destroy_image(egl->display, buffer.image);
+        buffer.image = nullptr;
+    }
+}
+
+void GLSharedFrames::wait(int fence_fd) {
+    if (fence_fd < 0) {
+        return;
+    }
+    EGLInterop const *egl = egl_interop();
+    if (egl && egl->native_fences) {
+        EGLint attribs[] = {EGL_SYNC_NATIVE_FENCE_FD_ANDROID, fence_fd, EGL_NONE};
+        EGLSyncKHR sync = egl->create_sync(egl->display, EGL_SYNC_NATIVE_FENCE_ANDROID, attribs);
+        if (sync != EGL_NO_SYNC_KHR) {
+            // the sync owns the fd
+            egl->wait_sync(egl->display, sync, 0);
+            egl->destroy_sync(egl->display, sync);
+            return;
+        }
+    }
+    pollfd poll_fd{.fd = fence_fd, .events = POLLIN};
+    poll(&poll_fd, 1, -1);
+    close(fence_fd);
+}
+
+int GLSharedFrames::signal() {
+    EGLInterop const *egl = egl_interop();
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    if (egl && egl->native_fences) {
+        EGLint attribs[] = {EGL_NONE};
+        EGLSyncKHR sync = egl->create_sync(egl->display, EGL_SYNC_NATIVE_FENCE_ANDROID, attribs);
+        if (sync != EGL_NO_SYNC_KHR) {
+            // the fd exists once the fence is flushed
+            gl->glFlush();
+            int fd = egl->dup_native_fence(egl->display, sync);
+            egl->destroy_sync(egl->display, sync);
+            if (fd != EGL_NO_NATIVE_FENCE_FD_ANDROID) {
+                return fd;
+            }
+        }
+    }
+    gl->glFinish();
+    return -1;
+}
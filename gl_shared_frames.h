@@ -0,0 +1,97 @@
+#pragma once
+
+#include <QMutex>
+#include <QSize>
+#include <QtGui/qopengl.h>
+
+#include <vector>
+
+#include "render_service.h"
+
+class QQuickWindow;
+class QSGTexture;
+
+// The consumer side of a view for a Qt Quick scene graph on OpenGL over EGL: frames arrive on the
+// render service thread as dma-bufs, are imported as EGLImages into the scene graph's context and
+// sampled there without a copy. Each imported buffer stays a GL texture until its view recreates
+// its targets. With GLX instead of EGL nothing is imported (QT_XCB_GL_INTEGRATION=xcb_egl).
+class GLSharedFrames {
+   public:
+    GLSharedFrames(RenderService &service, ViewId view);
+
+    // Only closes what it holds, the GL objects go with release() or with the context.
+    ~GLSharedFrames();
+
+    GLSharedFrames(GLSharedFrames const &) = delete;
+    GLSharedFrames &operator=(GLSharedFrames const &) = delete;
+
+    // Render service thread. The frame becomes the pending one, a pending frame it replaces was
+    // never shown and goes back right away.
+    void receive(SharedFrame const &frame);
+
+    // Scene graph render thread, context current. Shows the pending frame: imports its buffer on
+    // first use, makes the context wait for its fence and hands the previously shown frame back.
+    // Returns false when there was none or its import failed.
+    bool update();
+
+    // Scene graph render thread, context current. Deletes the imports and hands the shown frame
+    // back; frames received later are imported again.
+    void release();
+
+    // The shown frame, texture 0 before the first one. Its content is the top left frameSize()
+    // texels of textureSize(), the first row on top.
+    GLuint texture() const {
+        return m_shownTexture;
+    }
+    uint32_t bufferId() const {
+        return m_shownId;
+    }
+    QSize textureSize() const {
+        return m_shownTextureSize;
+    }
+    QSize frameSize() const {
+        return m_shownSize;
+    }
+
+    // Scene graph render thread. The shown frame's texture wrapped for window's scene graph, null
+    // before the first frame. Wrapped once per buffer, so a steady view reuses its wrappers; they
+    // are deleted with the imports.
+    QSGTexture *sceneGraphTexture(QQuickWindow *window);
+
+   private:
+    struct Buffer {
+        // fd is our duplicate
+        SharedBuffer buffer;
+        void *image = nullptr;
+        GLuint texture = 0;
+        QSGTexture *sceneGraphTexture = nullptr;
+        // its frames go back unshown
+        bool failed = false;
+    };
+
+    Buffer *find(uint32_t id);
+
+    bool import(Buffer &buffer);
+
+    // deletes the import, keeps the fd
+    void unimport(Buffer &buffer);
+
+    // Makes the context wait for fence_fd (owned).
+    void wait(int fence_fd);
+
+    // A fence fd signaled when the commands issued so far finished, -1 after waiting for them.
+    int signal();
+
+    RenderService &m_service;
+    ViewId m_view;
+    // buffers and the pending frame
+    QMutex m_mutex;
+    std::vector<Buffer> m_buffers;
+    SharedFrame m_pending{};
+    bool m_hasPending = false;
+    // scene graph render thread
+    uint32_t m_shownId = 0;
+    GLuint m_shownTexture = 0;
+    QSize m_shownTextureSize;
+    QSize m_shownSize;
+};
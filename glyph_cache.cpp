@@ -0,0 +1,221 @@
+#include "glyph_cache.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+// ImGui compiles its copy of stb_truetype as static functions, this file gets its own.
+#define STBTT_STATIC
+#define STB_TRUETYPE_IMPLEMENTATION
+#include <imgui/imstb_truetype.h>
+
+using namespace wgpu;
+
+GlyphCache::GlyphCache(ImFont* font, uint32_t atlas_height, ImWchar const* ranges)
+: font(font), atlas(font->ContainerAtlas), font_info(std::make_unique<stbtt_fontinfo>()) {
+    assert(this->atlas->TexPixelsAlpha8 && font->ConfigDataCount == 1);
+
+    ImFontConfig const* config = font->ConfigData;
+    unsigned char const* data = static_cast<unsigned char const*>(config->FontData);
+    stbtt_InitFont(this->font_info.get(), data, stbtt_GetFontOffsetForIndex(data, config->FontNo));
+    this->scale = config->SizePixels > 0.0f
+                      ? stbtt_ScaleForPixelHeight(this->font_info.get(), config->SizePixels)
+                      : stbtt_ScaleForMappingEmToPixels(this->font_info.get(), -config->SizePixels);
+
+    for (ImWchar const* range = ranges; range[0]; range += 2) {
+        this->ranges.push_back(range[0]);
+        this->ranges.push_back(range[1]);
+    }
+
+    // Grow the atlas, the baked glyphs keep their pixel position so their V coordinates shrink.
+    int built_height = this->atlas->TexHeight;
+    int width = this->atlas->TexWidth;
+    // rounded up to whole 64 row blocks
+    int height = std::max<int>(atlas_height, (built_height + min_dynamic_rows + 63) / 64 * 64);
+    unsigned char* pixels = static_cast<unsigned char*>(IM_ALLOC(width * height));
+    memcpy(pixels, this->atlas->TexPixelsAlpha8, width * built_height);
+    memset(pixels + width * built_height, 0, width * (height - built_height));
+    IM_FREE(this->atlas->TexPixelsAlpha8);
+    this->atlas->TexPixelsAlpha8 = pixels;
+
+    float v_scale = static_cast<float>(built_height) / height;
+    for (ImFont* atlas_font : this->atlas->Fonts) {
+        for (ImFontGlyph& glyph : atlas_font->Glyphs) {
+            glyph.V0 *= v_scale;
+            glyph.V1 *= v_scale;
+        }
+    }
+    this->atlas->TexUvWhitePixel.y *= v_scale;
+    for (ImVec4& uv : this->atlas->TexUvLines) {
+        uv.y *= v_scale;
+        uv.w *= v_scale;
+    }
+    this->atlas->TexHeight = height;
+    this->atlas->TexUvScale.y = 1.0f / height;
+
+    this->static_glyph_count = font->Glyphs.Size;
+    this->first_dynamic_row = built_height + this->atlas->TexGlyphPadding;
+    this->shelf_y = this->first_dynamic_row;
+
+    font->MissingGlyphCallback = on_missing_glyph;
+    font->MissingGlyphUserData = this;
+}
+
+GlyphCache::~GlyphCache() {
+    this->font->MissingGlyphCallback = nullptr;
+    this->font->MissingGlyphUserData = nullptr;
+}
+
+void GlyphCache::on_missing_glyph(ImFont const* font, ImWchar c, void* user_data) {
+    GlyphCache* cache = static_cast<GlyphCache*>(user_data);
+    if (!cache->in_ranges(c) ||
+        std::find(cache->missing.begin(), cache->missing.end(), c) != cache->missing.end()) {
+        return;
+    }
+    cache->missing.push_back(c);
+}
+
+bool GlyphCache::in_ranges(ImWchar c) const {
+    for (size_t i = 0; i < this->ranges.size(); i += 2) {
+        if (c >= this->ranges[i] && c <= this->ranges[i + 1]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GlyphCache::allocate(uint32_t width, uint32_t height, uint32_t& x, uint32_t& y) {
+    uint32_t padding = this->atlas->TexGlyphPadding;
+    width += padding;
+    height += padding;
+    if (this->shelf_x + width > static_cast<uint32_t>(this->atlas->TexWidth)) {
+        this->shelf_x = 0;
+        this->shelf_y += this->shelf_height;
+        this->shelf_height = 0;
+    }
+    if (width > static_cast<uint32_t>(this->atlas->TexWidth) ||
+        this->shelf_y + height > static_cast<uint32_t>(this->atlas->TexHeight)) {
+        return false;
+    }
+    x = this->shelf_x;
+    y = this->shelf_y;
+    this->shelf_x += width;
+    this->shelf_height = std::max(this->shelf_height, height);
+    return true;
+}
+
+void GlyphCache::evict() {
+    for (int i = this->static_glyph_count; i < this->font->Glyphs.Size; i++) {
+        ImWchar c = static_cast<ImWchar>(this->font->Glyphs[i].Codepoint);
+        this->font->IndexLookup[c] = static_cast<ImWchar>(-1);
+        this->font->IndexAdvanceX[c] = this->font->FallbackAdvanceX;
+    }
+    for (ImWchar c : this->overflowed) {
+        this->font->IndexLookup[c] = static_cast<ImWchar>(-1);
+        this->font->IndexAdvanceX[c] = this->font->FallbackAdvanceX;
+    }
+    this->overflowed.clear();
+    this->font->Glyphs.resize(this->static_glyph_count);
+    this->font->FallbackGlyph = this->font->FindGlyphNoFallback(this->font->FallbackChar);
+
+    this->shelf_x = 0;
+    this->shelf_y = this->first_dynamic_row;
+    this->shelf_height = 0;
+}
+
+// Code points the font has no glyph for render as the fallback glyph without asking again.
+void GlyphCache::map_to_fallback(ImWchar c) {
+    if (!this->font->FallbackGlyph) {
+        return;
+    }
+    this->font->GrowIndex(c + 1);
+    this->font->IndexLookup[c] =
+        static_cast<ImWchar>(this->font->FallbackGlyph - this->font->Glyphs.Data);
+    this->font->IndexAdvanceX[c] = this->font->FallbackAdvanceX;
+}
+
+bool GlyphCache::update(StagingBelt& belt) {
+    if (this->missing.empty()) {
+        return false;
+    }
+
+    ImFontConfig const* config = this->font->ConfigData;
+    float offset_x = config->GlyphOffset.x;
+    float offset_y = config->GlyphOffset.y + std::round(this->font->Ascent);
+    uint32_t padding = this->atlas->TexGlyphPadding;
+    uint32_t atlas_width = this->atlas->TexWidth;
+    unsigned char* pixels = this->atlas->TexPixelsAlpha8;
+
+    uint32_t dirty_x0 = atlas_width, dirty_y0 = this->atlas->TexHeight, dirty_x1 = 0, dirty_y1 = 0;
+    for (ImWchar c : this->missing) {
+        int glyph = stbtt_FindGlyphIndex(this->font_info.get(), c);
+        if (glyph == 0) {
+            map_to_fallback(c);
+            continue;
+        }
+
+        int x0, y0, x1, y1;
+        stbtt_GetGlyphBitmapBox(this->font_info.get(), glyph, this->scale, this->scale, &x0, &y0,
+                                &x1, &y1);
+        uint32_t width = x1 - x0;
+        uint32_t height = y1 - y0;
+        uint32_t x, y;
+        if (!allocate(width, height, x, y)) {
+            if (this->retrying || cached_glyph_count() == 0) {
+                // even emptied rows can't hold the glyphs in use, evicting again would never settle
+                map_to_fallback(c);
+                this->overflowed.push_back(c);
+                continue;
+            }
+            // This frame's draw data may still reference the cached glyphs, so their pixels are
+            // left alone. The misses are kept and retried once next frame, together with the
+            // glyphs in use, which are missed again.
+            evict();
+            this->retrying = true;
+            return true;
+        }
+
+        // clear the padding left by evicted glyphs, as it is sampled by bilinear filtering
+        for (uint32_t row = y; row < y + height + padding; row++) {
+            memset(pixels + row * atlas_width + x, 0, width + padding);
+        }
+        stbtt_MakeGlyphBitmap(this->font_info.get(), pixels + y * atlas_width + x, width, height,
+                              atlas_width, this->scale, this->scale, glyph);
+
+        int advance, left_side_bearing;
+        stbtt_GetGlyphHMetrics(this->font_info.get(), glyph, &advance, &left_side_bearing);
+        ImVec2 uv_scale = this->atlas->TexUvScale;
+        this->font->AddGlyph(config, c, x0 + offset_x, y0 + offset_y, x1 + offset_x, y1 + offset_y,
+                             x * uv_scale.x, y * uv_scale.y, (x + width) * uv_scale.x,
+                             (y + height) * uv_scale.y, advance * this->scale);
+        this->font->GrowIndex(c + 1);
+        this->font->IndexLookup[c] = static_cast<ImWchar>(this->font->Glyphs.Size - 1);
+        this->font->IndexAdvanceX[c] = this->font->Glyphs.back().AdvanceX;
+        // AddGlyph() may have moved the glyphs
+        this->font->FallbackGlyph = this->font->FindGlyphNoFallback(this->font->FallbackChar);
+
+        dirty_x0 = std::min(dirty_x0, x);
+        dirty_y0 = std::min(dirty_y0, y);
+        dirty_x1 = std::max(dirty_x1, x + width + padding);
+        dirty_y1 = std::max(dirty_y1, y + height + padding);
+    }
+    this->missing.clear();
+    this->retrying = false;
+    // the lookup tables are already up to date
+    this->font->DirtyLookupTables = false;
+
+    if (dirty_x1 > dirty_x0 && dirty_y1 > dirty_y0 && this->texture) {
+        ImageCopyTexture dest{
+            .texture = this->texture,
+            .origin = {.x = dirty_x0, .y = dirty_y0},
+        };
+        Extent3D write_size{
+            .width = dirty_x1 - dirty_x0,
+            .height = dirty_y1 - dirty_y0,
+        };
+        belt.write_texture(dest, pixels + dirty_y0 * atlas_width + dirty_x0, atlas_width,
+                           write_size);
+    }
+    return true;
+}
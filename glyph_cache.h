@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <imgui/imgui.h>
+#include <webgpu/webgpu_cpp.h>
+
+#include "staging_belt.h"
+
+struct stbtt_fontinfo;
+
+// Rasterizes glyphs of a font lazily. Only a small set of glyphs is baked when the atlas is built;
+// the atlas is then grown to a fixed height, keeping at least min_dynamic_rows free, and glyphs
+// missed by ImGui are rasterized into the added rows between frames, uploading only the rectangle
+// that changed. When the rows are full all cached glyphs are evicted at once, so the atlas never
+// grows beyond its initial size. Glyphs that don't fit right after an eviction render as the
+// fallback glyph instead of evicting again.
+class GlyphCache {
+public:
+    // font: built font of a single TrueType source. ranges: zero terminated code point pairs, as
+    // for ImFontConfig::GlyphRanges, that may be rasterized on demand. Must be created before the
+    // atlas pixels are uploaded, as it changes the atlas height.
+    GlyphCache(ImFont* font, uint32_t atlas_height, ImWchar const* ranges);
+
+    // rows added below the baked glyphs even when atlas_height leaves less room
+    static constexpr uint32_t min_dynamic_rows = 256;
+
+    ~GlyphCache();
+
+    // texture: the atlas texture, already holding the pixels of the built atlas.
+    void set_texture(wgpu::Texture texture) {
+        this->texture = texture;
+    }
+
+    // Rasterizes the glyphs missed since the last call and stages their upload on belt. Call
+    // between ImGui::Render() and drawing. Returns true when glyphs were added or evicted; text uses them
+    // from the next frame on.
+    bool update(StagingBelt& belt);
+
+    uint32_t cached_glyph_count() const {
+        return static_cast<uint32_t>(this->font->Glyphs.Size) - this->static_glyph_count;
+    }
+
+private:
+    static void on_missing_glyph(ImFont const* font, ImWchar c, void* user_data);
+
+    bool in_ranges(ImWchar c) const;
+
+    // Shelf allocation in the dynamic rows, returns false when full.
+    bool allocate(uint32_t width, uint32_t height, uint32_t& x, uint32_t& y);
+
+    void evict();
+
+    void map_to_fallback(ImWchar c);
+
+    ImFont* font;
+    ImFontAtlas* atlas;
+    std::unique_ptr<stbtt_fontinfo> font_info;
+    float scale;
+    std::vector<ImWchar> ranges;
+    wgpu::Texture texture;
+
+    uint32_t static_glyph_count;
+    uint32_t first_dynamic_row;
+    uint32_t shelf_x = 0;
+    uint32_t shelf_y = 0;
+    uint32_t shelf_height = 0;
+    // the last update evicted, its misses get one more try
+    bool retrying = false;
+
+    std::vector<ImWchar> missing;
+    // shown as the fallback for lack of room, missed again after the next eviction
+    std::vector<ImWchar> overflowed;
+};
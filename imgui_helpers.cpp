@@ -1,14 +1,21 @@
 #include "imgui_helpers.h"
 
-/* #include <algorithm> */
 /* #include <unordered_map> */
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
+#include <filesystem>
 #include <iostream>
 #include <string_view>
 
 #include "imgui/imgui.h"
 #include "imgui/imgui_internal.h"
+#include "allocation_counter.h"
+#include "compact_vertex.h"
+#include "font_atlas_cache.h"
+#include "shaders.h"
+#include "thread_pool.h"
 #include "webgpu_helpers.h"
 
 using namespace wgpu;
@@ -20,9 +27,23 @@ using namespace wgpu;
 
 /* ImGuiKey convertToImGuiKey(UI::Key::Enum key); */
 
-ImGuiWebGPU::ImGuiWebGPU(Device device) {
+// ImFontAtlas::BuildParallelFor on the shared thread pool.
+static void parallel_for_fonts(int count, void (*func)(int index, void* user_data), void* user_data,
+                               void* pool) {
+    static_cast<ThreadPool*>(pool)->parallel_for(
+        count, [&](uint32_t i) { func(static_cast<int>(i), user_data); });
+}
+
+ImGuiWebGPU::ImGuiWebGPU(Device device, StagingBelt& belt, ObjectRegistry& registry,
+                         ResourcePool& pool, FrameUniforms& uniforms, char const* font_path,
+                         float font_size, bool compact_vertices) {
     this->context = ImGui::CreateContext();
     this->device = device;
+    this->belt = &belt;
+    this->registry = &registry;
+    this->pool = &pool;
+    this->uniforms = &uniforms;
+    this->compact_vertices = compact_vertices;
 
     ImGuiIO& io = ImGui::GetIO();
 
@@ -38,100 +59,170 @@ ImGuiWebGPU::ImGuiWebGPU(Device device) {
     style.AntiAliasedLines = true;
     style.AntiAliasedLinesUseTex = false;
 
-    // Create pipeline
-    VertexAttribute attributes[3] = {
-        {.format = VertexFormat::Float32x2, .offset = 0, .shaderLocation = 0},
-        {.format = VertexFormat::Float32x2, .offset = 8, .shaderLocation = 1},
-        {.format = VertexFormat::Unorm8x4, .offset = 16, .shaderLocation = 2},
+    // Explicit layouts, so that bind groups don't depend on the pipeline, which compiles
+    // asynchronously while the font atlas is baked and may be replaced by reloaded shaders.
+    BindGroupLayoutEntry pass_layout_entries[2] = {
+        {.binding = 0,
+         .visibility = ShaderStage::Vertex,
+         .buffer = {.type = BufferBindingType::Uniform,
+                    .hasDynamicOffset = true,
+                    .minBindingSize = 16}},
+        {.binding = 1,
+         .visibility = ShaderStage::Fragment,
+         .sampler = {.type = SamplerBindingType::Filtering}},
     };
-    VertexBufferLayout vertex_layout{
-        .arrayStride = sizeof(ImDrawVert),
-        .attributeCount = 3,
-        .attributes = attributes,
+    BindGroupLayoutEntry texture_layout_entry{
+        .binding = 0,
+        .visibility = ShaderStage::Fragment,
+        .texture = {.sampleType = TextureSampleType::Float,
+                    .viewDimension = TextureViewDimension::e2D},
     };
+    BindGroupLayoutDescriptor pass_layout_desc{
+        .label = "ui pass",
+        .entryCount = 2,
+        .entries = pass_layout_entries,
+    };
+    BindGroupLayoutDescriptor texture_layout_desc{
+        .label = "ui texture",
+        .entryCount = 1,
+        .entries = &texture_layout_entry,
+    };
+    this->pass_layout = registry.get_bind_group_layout(pass_layout_desc);
+    this->texture_layout = registry.get_bind_group_layout(texture_layout_desc);
+    BindGroupLayout bind_group_layouts[2] = {this->pass_layout, this->texture_layout};
+    PipelineLayoutDescriptor pipeline_layout_desc{
+        .label = "ui",
+        .bindGroupLayoutCount = 2,
+        .bindGroupLayouts = bind_group_layouts,
+    };
+    this->pipeline_layout = registry.get_pipeline_layout(pipeline_layout_desc);
+
+    this->module = registry.get_shader_module(ui_shader);
+    // the first variant is the one is_ready() checks
+    get_variant(default_target_format, 0);
+
+    this->sampler = registry.get_sampler();
+
+    // Font glyphs texture atlas. Glyph coverage is a single channel, the shader expands it.
+    // Startup only bakes ASCII; the glyph cache fills the rest of the 1024x1024 atlas on demand.
+    auto font_start = std::chrono::steady_clock::now();
+    static const ImWchar static_ranges[] = {0x0020, 0x007E, 0};
+    static const ImWchar dynamic_ranges[] = {0x0020, 0xFFFF, 0};
+    ImFontConfig font_config;
+    font_config.SizePixels = font_size;
+    font_config.OversampleH = 1;  // as rasterized by the glyph cache
+    font_config.GlyphRanges = static_ranges;
+    ImFont* font = font_path ? io.Fonts->AddFontFromFileTTF(font_path, font_size, &font_config)
+                             : nullptr;
+    if (!font) {
+        font = io.Fonts->AddFontDefault(&font_config);
+    }
+    io.Fonts->TexDesiredWidth = 1024;
+    std::filesystem::path atlas_cache_path = font_atlas_cache_path(io.Fonts);
+    bool atlas_cached = load_font_atlas(io.Fonts, atlas_cache_path);
+    if (!atlas_cached) {
+        // The ~95 ASCII glyphs are a single 128 glyph chunk, so this builds serially: about 0.3 ms
+        // for the default font at 13 px. Only fonts baking more glyphs are split across threads.
+        io.Fonts->BuildParallelFor = parallel_for_fonts;
+        io.Fonts->BuildParallelForUserData = &ThreadPool::instance();
+        io.Fonts->Build();
+        save_font_atlas(io.Fonts, atlas_cache_path);
+    }
+    this->glyph_cache = std::make_unique<GlyphCache>(font, 1024, dynamic_ranges);
 
-    const char* ui_source = R"WGSL(
-        struct Vertex {
-            @location(0) ss_pos: vec2f,
-            @location(1) uv: vec2f,
-            @location(2) color: vec4f,
-        };
-
-        struct VertexOutput {
-            @builtin(position) position: vec4f,
-            @location(0) uv: vec2f,
-            @location(1) color: vec4f,
-        };
-
-        struct DrawInfo {
-            tex_is_srgb: u32,
-            target_is_srgb: u32,
-        };
-
-        // (width, height, 1.0/width, 1.0/height)
-        @group(0) @binding(0) var<uniform> view_info: vec4f;
-        // draw flags: bit 0: texture_is_srgb
-        //             bit 1: target_is_srgb
-        @group(0) @binding(1) var<uniform> draw_flags : u32;
+    uint8_t* data;
+    int32_t w, h;
+    io.Fonts->GetTexDataAsAlpha8(&data, &w, &h);
+    uint32_t font_tex_width = static_cast<uint32_t>(w);
+    uint32_t font_tex_height = static_cast<uint32_t>(h);
+    size_t size = font_tex_width * font_tex_height;
 
-        @vertex fn vertexMain(vertex: Vertex) -> VertexOutput {
-            var out: VertexOutput;
+    TextureDescriptor font_tex_desc{
+        .label = "ImGui font texture",
+        .usage = TextureUsage::TextureBinding | TextureUsage::CopyDst,
+        .size = {.width = font_tex_width, .height = font_tex_height},
+        .format = TextureFormat::R8Unorm,
+    };
 
-            var cs_pos = 2.0 * (vertex.ss_pos * view_info.zw) - 1.0;
-            cs_pos.y = -cs_pos.y;
-            out.position = vec4f(cs_pos, 0.0, 1.0);
-            out.uv = vertex.uv;
-            out.color = vertex.color;
+    Texture font_texture = device.CreateTexture(&font_tex_desc);
+    ImageCopyTexture dest{
+        .texture = font_texture,
+    };
+    Extent3D write_size{
+        .width = font_tex_width,
+        .height = font_tex_height,
+    };
+    // copied with the first frame
+    belt.write_texture(dest, data, font_tex_width, write_size);
+
+    std::chrono::duration<double, std::milli> font_ms = std::chrono::steady_clock::now() - font_start;
+    std::cout << "Font atlas " << font_tex_width << "x" << font_tex_height << " R8Unorm: "
+              << size / 1024 << " KiB (RGBA8 would be " << size * 4 / 1024 << " KiB), "
+              << (atlas_cached ? "loaded from cache" : "built") << " and staged in "
+              << font_ms.count() << " ms\n";
+
+    this->textures.resize(1);  // reserve the null handle
+    this->font_texture_id = register_texture(font_texture);
+    io.Fonts->SetTexID(this->font_texture_id);
+    this->glyph_cache->set_texture(font_texture);
+}
 
-            return out;
+ImGuiWebGPU::PipelineVariant& ImGuiWebGPU::get_variant(TextureFormat target_format,
+                                                       uint32_t texture_flags) {
+    for (std::unique_ptr<PipelineVariant>& variant : this->variants) {
+        if (variant->target_format == target_format && variant->texture_flags == texture_flags) {
+            return *variant;
         }
+    }
 
-        @group(0) @binding(2) var draw_sampler: sampler;
-        @group(1) @binding(0) var draw_texture: texture_2d<f32>;
-
-        struct FragmentInput {
-            @builtin(position) position: vec4f,
-            @location(0) uv: vec2f,
-            @location(1) color: vec4f,
-        };
-
-        @fragment fn fragmentMain(fragment: FragmentInput) -> @location(0) vec4f {
-            var texture_is_srgb: bool = bool(draw_flags & 0x1);
-            var target_is_srgb: bool = bool(draw_flags & 0x2);
-            var texel = textureSample(draw_texture, draw_sampler, fragment.uv);
-            return fragment.color * texel;
+    PipelineVariant* variant = this->variants
+        .emplace_back(std::make_unique<PipelineVariant>(PipelineVariant{
+            .target_format = target_format,
+            .texture_flags = texture_flags,
+            .pending = true,
+        }))
+        .get();
+    auto created = [variant](RenderPipeline pipeline) {
+        variant->pending = false;
+        if (variant->pipeline) {
+            // a shader reload landed first
+            return;
+        }
+        variant->pipeline = pipeline;
+        if (!pipeline) {
+            variant->failed = true;
+            std::cout << "UI pipeline failed for target format "
+                      << static_cast<uint32_t>(variant->target_format) << ", texture flags "
+                      << variant->texture_flags << "\n";
         }
-    )WGSL";
+    };
+    variant->future = create_pipeline(this->module, target_format, texture_flags,
+                                      CallbackMode::AllowProcessEvents, created);
+    watch_variant(*variant);
+    return *variant;
+}
 
-    ShaderModuleWGSLDescriptor shader_desc;
-    shader_desc.code = ui_source;
-    ShaderModuleDescriptor module_desc{
-        .nextInChain = &shader_desc,
-        .label = "ui",
+Future ImGuiWebGPU::create_pipeline(ShaderModule module, TextureFormat target_format,
+                                    uint32_t texture_flags, CallbackMode mode,
+                                    PipelineCallback callback) const {
+    VertexAttribute attributes[3] = {
+        {.format = VertexFormat::Float32x2, .offset = 0, .shaderLocation = 0},
+        {.format = VertexFormat::Float32x2, .offset = 8, .shaderLocation = 1},
+        {.format = VertexFormat::Unorm8x4, .offset = 16, .shaderLocation = 2},
+    };
+    VertexAttribute compact_attributes[3] = {
+        {.format = VertexFormat::Sint16x2, .offset = 0, .shaderLocation = 0},
+        {.format = VertexFormat::Unorm16x2, .offset = 4, .shaderLocation = 1},
+        {.format = VertexFormat::Unorm8x4, .offset = 8, .shaderLocation = 2},
+    };
+    VertexBufferLayout vertex_layout{
+        .arrayStride = sizeof(ImDrawVert),
+        .attributeCount = 3,
+        .attributes = attributes,
     };
-    ShaderModule module = device.CreateShaderModule(&module_desc);
-    FutureWaitInfo build_log_future;
-    build_log_future.future = module.GetCompilationInfo(
-        CallbackMode::WaitAnyOnly,
-        [ui_source](CompilationInfoRequestStatus status, CompilationInfo const* info) {
-            /* if (status == CompilationInfoRequestStatus::Success && info->messageCount > 0) { */
-            /*     std::cout << "WGSL Compilation log:\n"; */
-            /*     static const char* msg_types[4] = { "", "Error", "Warning", "Info" }; */
-            /*     for (int i = 0; i < info->messageCount; i++) { */
-            /*         std::string_view excerpt(ui_source + info->messages[i].offset,
-             * info->messages[i].length); */
-            /*         std::cout */
-            /*         << "[" << msg_types[static_cast<uint32_t>(info->messages[i].type)] << "] " */
-            /*         << info->messages[i].lineNum << ": " << info->messages[i].message << "\n" */
-            /*         << excerpt << "\n"; */
-            /*     } */
-            /* } */
-        });
-
-    WaitStatus status = device.GetAdapter().GetInstance().WaitAny(1, &build_log_future, 0);
-    if (status != WaitStatus::Success || !build_log_future.completed) {
-        std::cout << "Shader compilation error\n";
-        // TODO roll back
+    if (this->compact_vertices) {
+        vertex_layout.arrayStride = sizeof(CompactDrawVert);
+        vertex_layout.attributes = compact_attributes;
     }
 
     /* DepthStencilState depth_stenci_state{ */
@@ -145,181 +236,255 @@ ImGuiWebGPU::ImGuiWebGPU(Device device) {
         .color = {.srcFactor = BlendFactor::SrcAlpha, .dstFactor = BlendFactor::OneMinusSrcAlpha},
     };
     ColorTargetState target{
-        .format = TextureFormat::BGRA8Unorm,
+        .format = target_format,
         .blend = &blend_state,
     };
+    // see the overrides in ui.wgsl
+    ConstantEntry constants[3] = {
+        {.key = "texture_is_srgb", .value = (texture_flags & TEXTURE_IS_SRGB) ? 1.0 : 0.0},
+        {.key = "target_is_srgb", .value = is_srgb(target_format) ? 1.0 : 0.0},
+        {.key = "texture_is_alpha", .value = (texture_flags & TEXTURE_IS_ALPHA) ? 1.0 : 0.0},
+    };
     FragmentState fragment_state{
         .module = module,
         .entryPoint = "fragmentMain",
+        .constantCount = 3,
+        .constants = constants,
         .targetCount = 1,
         .targets = &target,
     };
     RenderPipelineDescriptor pipeline_desc{
         .label = "ui",
+        .layout = this->pipeline_layout,
         .vertex =
             {
                 .module = module,
-                .entryPoint = "vertexMain",
+                .entryPoint = this->compact_vertices ? "vertexMainCompact" : "vertexMain",
                 .bufferCount = 1,
                 .buffers = &vertex_layout,
             },
         .fragment = &fragment_state,
     };
-    this->pipeline = device.CreateRenderPipeline(&pipeline_desc);
+    return this->registry->get_render_pipeline(pipeline_desc, mode, std::move(callback));
+}
 
-    // view info uniform buffer
-    BufferDescriptor view_uniform_desc{
-        .usage = BufferUsage::Uniform | BufferUsage::CopyDst,
-        .size = 16,
-    };
-    this->view_uniform_buffer = device.CreateBuffer(&view_uniform_desc);
+ImTextureID ImGuiWebGPU::register_texture(Texture texture) {
+    uint32_t handle;
+    if (!this->free_texture_handles.empty()) {
+        handle = this->free_texture_handles.back();
+        this->free_texture_handles.pop_back();
+    } else {
+        handle = static_cast<uint32_t>(this->textures.size());
+        this->textures.emplace_back();
+    }
 
-    // draw flags uniform buffer
-    BufferDescriptor draw_flags_uniform_desc{
-        .usage = BufferUsage::Uniform | BufferUsage::CopyDst,
-        .size = 4,
-    };
-    this->draw_flags_uniform_buffer = device.CreateBuffer(&draw_flags_uniform_desc);
-    uint32_t flags = 0;
-    device.GetQueue().WriteBuffer(this->draw_flags_uniform_buffer, 0, &flags, 4);
-
-    BindGroupEntry pass_bindings[3] = {
-        {.binding = 0, .buffer = this->view_uniform_buffer},
-        {.binding = 1, .buffer = this->draw_flags_uniform_buffer},
-        {.binding = 2, .sampler = device.CreateSampler()},
-    };
+    TextureEntry& entry = this->textures[handle];
+    entry.texture = texture;
+    entry.view = texture.CreateView();
+    entry.flags = is_srgb(texture.GetFormat()) ? TEXTURE_IS_SRGB : 0;
+    if (texture.GetFormat() == TextureFormat::R8Unorm) {
+        entry.flags |= TEXTURE_IS_ALPHA;
+    }
+
+    BindGroupEntry texture_entry{.binding = 0, .textureView = entry.view};
     BindGroupDescriptor bind_group_desc{
-        .layout = this->pipeline.GetBindGroupLayout(0),
-        .entryCount = 3,
-        .entries = pass_bindings,
+        .layout = this->texture_layout,
+        .entryCount = 1,
+        .entries = &texture_entry,
     };
-    this->bind_groups[0] = device.CreateBindGroup(&bind_group_desc);
+    entry.bind_group = this->device.CreateBindGroup(&bind_group_desc);
 
-    // Font glyphs texture atlas
-    uint8_t* data;
-    int32_t w, h;
-    io.Fonts->GetTexDataAsRGBA32(&data, &w, &h);
-    uint32_t font_tex_width = static_cast<uint32_t>(w);
-    uint32_t font_tex_height = static_cast<uint32_t>(h);
-    size_t size = font_tex_width * font_tex_height * 4;
+    // compiles before the texture is first drawn
+    get_variant(default_target_format, entry.flags);
 
-    TextureDescriptor font_tex_desc{
-        .label = "ImGui font texture",
-        .usage = TextureUsage::TextureBinding | TextureUsage::CopyDst,
-        .size = {.width = font_tex_width, .height = font_tex_height},
-        //.format = TextureFormat::BGRA8Unorm,
-        .format = TextureFormat::RGBA8Unorm,
-    };
+    return reinterpret_cast<ImTextureID>(static_cast<uintptr_t>(handle));
+}
 
-    this->font_texture = device.CreateTexture(&font_tex_desc);
-    ImageCopyTexture dest{
-        .texture = this->font_texture,
-    };
-    Extent3D write_size{
-        .width = font_tex_width,
-        .height = font_tex_height,
-    };
-    TextureDataLayout layout{
-        .bytesPerRow = font_tex_width * 4,
-    };
-    device.GetQueue().WriteTexture(&dest, data, size, &layout, &write_size);
-    io.Fonts->SetTexID((void*)&font_texture);
+void ImGuiWebGPU::unregister_texture(ImTextureID id) {
+    uint32_t handle = texture_handle(id);
+    assert(handle > 0 && handle < this->textures.size() && this->textures[handle].texture);
+    this->textures[handle] = {};
+    this->free_texture_handles.push_back(handle);
+}
 
-    // font texture bind group
-    BindGroupEntry font_texture_entry{
-        .binding = 0,
-        .textureView = this->font_texture.CreateView(),
-    };
-    bind_group_desc = {
-        .layout = this->pipeline.GetBindGroupLayout(1),
-        .entryCount = 1,
-        .entries = &font_texture_entry,
-    };
-    this->bind_groups[1] = device.CreateBindGroup(&bind_group_desc);
-    this->last_texture = &this->font_texture;
+void ImGuiWebGPU::watch_shader(ShaderWatcher& watcher) {
+    this->watcher = &watcher;
+    for (std::unique_ptr<PipelineVariant>& variant : this->variants) {
+        watch_variant(*variant);
+    }
+}
+
+void ImGuiWebGPU::watch_variant(PipelineVariant& variant) {
+    if (!this->watcher) {
+        return;
+    }
+    this->watcher->watch(
+        "ui",
+        [this, format = variant.target_format, texture_flags = variant.texture_flags](
+            ShaderModule module, CallbackMode mode, PipelineCallback callback) {
+            return create_pipeline(module, format, texture_flags, mode, std::move(callback));
+        },
+        &variant.pipeline);
+}
+
+bool ImGuiWebGPU::wait_until_ready() {
+    Instance instance = this->device.GetAdapter().GetInstance();
+    bool ready = true;
+    for (std::unique_ptr<PipelineVariant>& variant : this->variants) {
+        if (variant->pending) {
+            FutureWaitInfo created{.future = variant->future};
+            instance.WaitAny(1, &created, UINT64_MAX);
+        }
+        ready = ready && !variant->failed;
+    }
+    return ready;
 }
 
 ImGuiWebGPU::~ImGuiWebGPU() {
+    // the pipeline callbacks reference the variants
+    wait_until_ready();
+    this->glyph_cache.reset();
     if (context) {
         ImGui::DestroyContext(context);
     }
 }
 
-void ImGuiWebGPU::begin_frame(uint32_t win_width, uint32_t win_height) {
+void ImGuiWebGPU::begin_frame(uint32_t slot, uint32_t win_width, uint32_t win_height) {
+    assert(slot < FrameTracker::max_frames_in_flight);
+    this->slot = slot;
+
     ImGuiIO& io = ImGui::GetIO();
+    if (this->compact_vertices) {
+        // larger targets get the UI in their top left corner, unscaled, rather than clamped
+        // positions; the viewport follows DisplaySize
+        win_width = std::min(win_width, compact_max_extent);
+        win_height = std::min(win_height, compact_max_extent);
+    }
     io.DisplaySize = ImVec2(win_width, win_height);
 
     float view_info[4] = {io.DisplaySize.x, io.DisplaySize.y, 1.0f / io.DisplaySize.x,
                           1.0f / io.DisplaySize.y};
-    this->device.GetQueue().WriteBuffer(this->view_uniform_buffer, 0, view_info, 16);
+    this->view_info_offset = this->uniforms->allocate(view_info);
+    if (this->pass_bind_group_buffer.Get() != this->uniforms->get_buffer().Get()) {
+        this->pass_bind_group_buffer = this->uniforms->get_buffer();
+        BindGroupEntry pass_bindings[2] = {
+            {.binding = 0, .buffer = this->pass_bind_group_buffer, .size = 16},
+            {.binding = 1, .sampler = this->sampler},
+        };
+        BindGroupDescriptor bind_group_desc{
+            .layout = this->pass_layout,
+            .entryCount = 2,
+            .entries = pass_bindings,
+        };
+        this->pass_bind_group = this->device.CreateBindGroup(&bind_group_desc);
+    }
 
     ImGui::NewFrame();
 }
 
-void ImGuiWebGPU::end_frame(Texture target) {
+void ImGuiWebGPU::reserve_buffer(Buffer& buffer, BufferUsage usage, uint64_t size,
+                                 char const* label) {
+    if (buffer && buffer.GetSize() >= size) {
+        return;
+    }
+    // power of two sizes, see ResourcePool::size_class()
+    this->pool->release(buffer);
+    buffer = this->pool->acquire_buffer(usage | BufferUsage::CopyDst, std::max<uint64_t>(size, 4096),
+                                        label);
+}
+
+void ImGuiWebGPU::end_frame(Texture target, CommandEncoder encoder) {
     ImGui::Render();
 
-    uint32_t draw_flags = is_srgb(target.GetFormat()) << 1 | this->last_draw_flags & 0x1;
+    // glyphs missed while building this frame
+    this->glyph_cache_changed = this->glyph_cache->update(*this->belt);
 
-    ImDrawData* draw_data = ImGui::GetDrawData();
+    TextureFormat target_format = target.GetFormat();
+    PipelineVariant* base_variant = &get_variant(target_format, 0);
 
-    CommandEncoder encoder = this->device.CreateCommandEncoder();
+    ImDrawData* draw_data = ImGui::GetDrawData();
+    if (draw_data->TotalVtxCount == 0 || !base_variant->pipeline) {
+        this->last_upload_bytes = 0;
+        return;
+    }
 
+    // All draw lists share the vertex and index buffer of the frame slot. Their data is copied
+    // into one staging belt allocation at precomputed offsets, in parallel for large UIs, and
+    // moved by one copy per buffer. Index ranges start on 4 byte boundaries, as copies require.
+    FrameResources& frame = this->frames[this->slot];
+    uint64_t vertex_stride = this->compact_vertices ? sizeof(CompactDrawVert) : sizeof(ImDrawVert);
+    uint64_t vertex_size = 0;
+    uint64_t index_size = 0;
+    this->list_offsets.resize(draw_data->CmdListsCount);
     for (int n = 0; n < draw_data->CmdListsCount; n++) {
-        const ImDrawList* commands = draw_data->CmdLists[n];
-        const ImDrawVert* ui_vertices = commands->VtxBuffer.Data;
-        const ImDrawIdx* ui_indices = commands->IdxBuffer.Data;
-
-        uint32_t num_vertices = (uint32_t)commands->VtxBuffer.size();
-
-        BufferDescriptor vb_desc{
-            .label = "ui vertex buffer",
-            .usage = BufferUsage::Vertex | BufferUsage::CopyDst,
-            .size =
-                sizeof(ImDrawVert) * num_vertices,  // note: ImDrawVert is already a multiple of 4
-        };
-        Buffer v_buffer = this->device.CreateBuffer(&vb_desc);
-
-        this->device.GetQueue().WriteBuffer(v_buffer, 0, ui_vertices, vb_desc.size);
-
-        uint32_t size = commands->IdxBuffer.size_in_bytes();
-        BufferDescriptor ib_desc{
-            .label = "ui index buffer",
-            .usage = BufferUsage::Index | BufferUsage::CopyDst,
-            .size = align_up(size, 4),
-        };
-        Buffer i_buffer = this->device.CreateBuffer(&ib_desc);
+        this->list_offsets[n] = {vertex_size, index_size};
+        vertex_size += draw_data->CmdLists[n]->VtxBuffer.Size * vertex_stride;
+        index_size += align_up(draw_data->CmdLists[n]->IdxBuffer.size_in_bytes(), 4);
+    }
+    reserve_buffer(frame.vertex_buffer, BufferUsage::Vertex, vertex_size, "ui vertex buffer");
+    reserve_buffer(frame.index_buffer, BufferUsage::Index, index_size, "ui index buffer");
 
-        if (commands->IdxBuffer.capacity() * sizeof(uint16_t) >= ib_desc.size) {
-            // use extra capacity to write up to alignment
-            this->device.GetQueue().WriteBuffer(i_buffer, 0, ui_indices, ib_desc.size);
+    StagingBelt::Allocation allocation = this->belt->allocate(vertex_size + index_size);
+    uint8_t* staging = allocation.data;
+    uint8_t* staging_indices = staging + vertex_size;
+    auto copy_list = [&](uint32_t n) {
+        const ImDrawList* commands = draw_data->CmdLists[n];
+        auto [vertex_offset, index_offset] = this->list_offsets[n];
+        if (this->compact_vertices) {
+            convert_vertices(commands->VtxBuffer.Data,
+                             reinterpret_cast<CompactDrawVert*>(staging + vertex_offset),
+                             commands->VtxBuffer.Size);
         } else {
-            uint32_t aligned_size = align_up(size - 4, 4);
-            this->device.GetQueue().WriteBuffer(i_buffer, 0, ui_indices, aligned_size);
-            uint8_t rest[4];
-            memcpy(rest, ((uint8_t*)ui_indices) + aligned_size, size - aligned_size);
-            this->device.GetQueue().WriteBuffer(i_buffer, aligned_size, rest, 4);
+            memcpy(staging + vertex_offset, commands->VtxBuffer.Data,
+                   commands->VtxBuffer.size_in_bytes());
         }
+        memcpy(staging_indices + index_offset, commands->IdxBuffer.Data,
+               commands->IdxBuffer.size_in_bytes());
+    };
+    if (vertex_size + index_size >= parallel_upload_threshold) {
+        ThreadPool::instance().parallel_for(draw_data->CmdListsCount, copy_list);
+    } else {
+        for (int n = 0; n < draw_data->CmdListsCount; n++) {
+            copy_list(n);
+        }
+    }
+    this->belt->copy(allocation, 0, frame.vertex_buffer, 0, vertex_size);
+    this->belt->copy(allocation, vertex_size, frame.index_buffer, 0, index_size);
+    this->last_upload_bytes = vertex_size + index_size;
 
-        // std::cout << "Draw list #" << n << ": " << num_vertices << " vertices, "
-        //     << commands->IdxBuffer.size() << " indices\n";
-
-        RenderPassColorAttachment colorAttachment{
-            .view = target.CreateView(),
-            .loadOp = LoadOp::Load,
-            .storeOp = StoreOp::Store,
-        };
-        RenderPassDescriptor pass_desc{
-            .colorAttachmentCount = 1,
-            .colorAttachments = &colorAttachment,
-        };
-        RenderPassEncoder pass = encoder.BeginRenderPass(&pass_desc);
+    if (target.Get() != this->target.Get()) {
+        this->target = target;
+        this->target_view = target.CreateView();
+    }
+    RenderPassColorAttachment colorAttachment{
+        .view = this->target_view,
+        .loadOp = LoadOp::Load,
+        .storeOp = StoreOp::Store,
+    };
+    RenderPassDescriptor pass_desc{
+        .colorAttachmentCount = 1,
+        .colorAttachments = &colorAttachment,
+    };
+    // The draw loop in between the WebGPU calls only reads the draw lists.
+    WebGPUAllocations webgpu;
+    RenderPassEncoder pass = encoder.BeginRenderPass(&pass_desc);
+
+    // the target may be larger than the display size
+    pass.SetViewport(0.0f, 0.0f, draw_data->DisplaySize.x, draw_data->DisplaySize.y, 0.0f, 1.0f);
+    pass.SetPipeline(base_variant->pipeline);
+    PipelineVariant* bound_variant = base_variant;
+    pass.SetVertexBuffer(0, frame.vertex_buffer);
+    pass.SetIndexBuffer(frame.index_buffer, IndexFormat::Uint16);
+    pass.SetBindGroup(0, this->pass_bind_group, 1, &this->view_info_offset);
+    uint32_t bound_texture = 0;
+
+    uint32_t base_vertex = 0;
+    uint32_t base_index = 0;
+    for (int n = 0; n < draw_data->CmdListsCount; n++) {
+        const ImDrawList* commands = draw_data->CmdLists[n];
 
-        pass.SetPipeline(this->pipeline);
-        pass.SetVertexBuffer(0, v_buffer);
-        pass.SetIndexBuffer(i_buffer, IndexFormat::Uint16);
-        pass.SetBindGroup(0, this->bind_groups[0]);
-        pass.SetBindGroup(1, this->bind_groups[1]);
+        // std::cout << "Draw list #" << n << ": " << commands->VtxBuffer.size() << " vertices, "
+        //     << commands->IdxBuffer.size() << " indices\n";
 
         for (int cmd = 0; cmd < commands->CmdBuffer.Size; cmd++) {
             const ImDrawCmd* pcmd = &commands->CmdBuffer[cmd];
@@ -335,40 +500,93 @@ void ImGuiWebGPU::end_frame(Texture target) {
                                     static_cast<uint32_t>(pcmd->ClipRect.z - pcmd->ClipRect.x),
                                     static_cast<uint32_t>(pcmd->ClipRect.w - pcmd->ClipRect.y));
 
-                // TODO: lower to WGPUTexture type and use Acquire/release ?
-                Texture* texture = static_cast<Texture*>(pcmd->TextureId);
-                if (texture->Get() != this->last_texture->Get()) {
-                    if (texture->Get() == this->font_texture.Get()) {
-                        pass.SetBindGroup(1, this->bind_groups[1]);
-                    } else {
-                        BindGroupEntry texture_entry{
-                            .binding = 0,
-                            .textureView = texture->CreateView(),
-                        };
-                        BindGroupDescriptor bind_group_desc{
-                            .layout = this->pipeline.GetBindGroupLayout(1),
-                            .entryCount = 1,
-                            .entries = &texture_entry,
-                        };
-                        this->bind_groups[2] = device.CreateBindGroup(&bind_group_desc);
-                        pass.SetBindGroup(1, this->bind_groups[2]);
+                uint32_t handle = texture_handle(pcmd->TextureId);
+                assert(handle > 0 && handle < this->textures.size());
+                TextureEntry const& texture = this->textures[handle];
+
+                PipelineVariant* variant = &get_variant(target_format, texture.flags);
+                if (!variant->pipeline) {
+                    if (!variant->failed) {
+                        // still compiling, drawn once it is ready
+                        continue;
                     }
-                    this->last_texture = texture;
+                    // off sRGB or alpha handling beats not drawing at all, until a reload
+                    variant = base_variant;
                 }
-
-                draw_flags |= is_srgb(texture->GetFormat()) & 0x1;
-                if (draw_flags != this->last_draw_flags) {
-                    this->device.GetQueue().WriteBuffer(this->draw_flags_uniform_buffer, 0,
-                                                        &draw_flags, 4);
-                    this->last_draw_flags = draw_flags;
+                if (variant != bound_variant) {
+                    pass.SetPipeline(variant->pipeline);
+                    bound_variant = variant;
+                }
+                if (handle != bound_texture) {
+                    pass.SetBindGroup(1, texture.bind_group);
+                    bound_texture = handle;
                 }
 
-                pass.DrawIndexed(pcmd->ElemCount, 1, pcmd->IdxOffset, pcmd->VtxOffset);
+                pass.DrawIndexed(pcmd->ElemCount, 1, base_index + pcmd->IdxOffset,
+                                 base_vertex + pcmd->VtxOffset);
             }
         }
-        pass.End();
+
+        base_vertex += commands->VtxBuffer.Size;
+        base_index += align_up(commands->IdxBuffer.Size, 2);
+    }
+    pass.End();
+}
+
+ImGuiInput::ImGuiInput() {
+    // a frame's worth of mouse moves, feeding them doesn't allocate
+    this->events.reserve(64);
+    this->frame_events.reserve(64);
+}
+
+void ImGuiInput::add_mouse_pos(float x, float y) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->events.push_back({.type = Event::Type::Pos, .x = x, .y = y});
+}
+
+void ImGuiInput::add_mouse_button(int button, bool down) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->events.push_back({.type = Event::Type::Button, .button = button, .down = down});
+}
+
+void ImGuiInput::add_mouse_wheel(float x, float y) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->events.push_back({.type = Event::Type::Wheel, .x = x, .y = y});
+}
+
+void ImGuiInput::feed(float display_width, float display_height) {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        std::swap(this->events, this->frame_events);
     }
+    ImGuiIO& io = ImGui::GetIO();
+    for (Event const& event : this->frame_events) {
+        switch (event.type) {
+            case Event::Type::Pos:
+                io.AddMousePosEvent(event.x * display_width, event.y * display_height);
+                break;
+            case Event::Type::Button:
+                io.AddMouseButtonEvent(event.button, event.down);
+                break;
+            case Event::Type::Wheel:
+                io.AddMouseWheelEvent(event.x, event.y);
+                break;
+        }
+    }
+    this->frame_events.clear();
+}
 
-    CommandBuffer cmd_buffer = encoder.Finish();
-    this->device.GetQueue().Submit(1, &cmd_buffer);
+bool ImGuiInput::is_idle() {
+    // Must run before ImGui::NewFrame() drains the input queue. ImGui needs a few more frames
+    // after the last event to settle hover and animation state.
+    ImGuiContext* context = ImGui::GetCurrentContext();
+    if (context && context->InputEventsQueue.Size > 0) {
+        this->refresh_frame_count = 3;
+        return false;
+    }
+    if (this->refresh_frame_count > 0) {
+        this->refresh_frame_count--;
+        return false;
+    }
+    return true;
 }
@@ -1,39 +1,203 @@
 #pragma once
 
+#include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <imgui/imgui.h>
 #include <webgpu/webgpu_cpp.h>
 
+#include "compact_vertex.h"
+#include "frame_uniforms.h"
+#include "glyph_cache.h"
+#include "object_registry.h"
+#include "resource_pool.h"
+#include "shader_watcher.h"
+#include "staging_belt.h"
+#include "webgpu_helpers.h"
+
 class ImGuiWebGPU {
 public:
-    ImGuiWebGPU(wgpu::Device device);
+    // font_path: TrueType font of the UI, the embedded default font when null. Only ASCII is
+    // baked at startup, other glyphs go through the glyph cache.
+    // compact_vertices: upload vertices as 12 byte CompactDrawVert instead of ImDrawVert. The UI
+    // then covers at most compact_max_extent pixels in each direction.
+    // belt: all uploads are staged on it, it must outlive this object.
+    // registry: layouts, sampler and pipelines come from it, it must outlive this object.
+    // pool: geometry buffers are recycled through it, it must outlive this object.
+    // uniforms: the view info goes there, begin_frame() must come after its begin_frame(). It
+    // must outlive this object.
+    ImGuiWebGPU(wgpu::Device device, StagingBelt& belt, ObjectRegistry& registry,
+                ResourcePool& pool, FrameUniforms& uniforms, char const* font_path = nullptr,
+                float font_size = 13.0f, bool compact_vertices = false);
 
     ~ImGuiWebGPU();
 
-    void begin_frame(uint32_t win_width, uint32_t win_height);
+    // slot: frame slot from FrameTracker, selects the geometry buffers of the frame.
+    void begin_frame(uint32_t slot, uint32_t win_width, uint32_t win_height);
+
+    // Pipelines are created asynchronously, until the one of the default target format is ready
+    // end_frame() draws nothing.
+    bool is_ready() const {
+        return bool(this->variants.front()->pipeline);
+    }
+
+    // Blocks until the variants created so far are compiled. False when one of them failed.
+    bool wait_until_ready();
+
+    // Swaps in the pipelines of shaders/ui.wgsl when it changes. Variants created afterwards are
+    // registered too, so watcher must stay alive as long as frames are drawn.
+    void watch_shader(ShaderWatcher& watcher);
+
+    // Records the UI pass into encoder. Its uploads are staged on the belt, whose command buffer
+    // must be submitted ahead of encoder.
+    void end_frame(wgpu::Texture target, wgpu::CommandEncoder encoder);
+
+    // Makes texture usable with ImGui::Image(). The returned id is a small integer handle that
+    // stays valid until unregister_texture(); view and bind group are created once, here.
+    ImTextureID register_texture(wgpu::Texture texture);
 
-    void end_frame(wgpu::Texture target);
+    void unregister_texture(ImTextureID id);
+
+    // True when the last frame added or evicted glyphs, which show up in the next frame.
+    bool glyphs_changed() const {
+        return this->glyph_cache_changed;
+    }
+
+    // Vertex and index bytes written by the last end_frame().
+    uint64_t get_last_upload_bytes() const {
+        return this->last_upload_bytes;
+    }
 
 private:
+    // select the pipeline variant, see the overrides in ui.wgsl
+    enum TextureFlags : uint32_t {
+        TEXTURE_IS_SRGB = 0x1,
+        // single channel coverage, sampled as (1, 1, 1, r)
+        TEXTURE_IS_ALPHA = 0x2,
+    };
+
+    struct TextureEntry {
+        wgpu::Texture texture;
+        wgpu::TextureView view;
+        wgpu::BindGroup bind_group;
+        uint32_t flags = 0;
+    };
+
+    // One specialization of the UI shader: the sRGB and alpha handling is fixed through override
+    // constants instead of being branched on per fragment. target_is_srgb follows from
+    // target_format, texture_is_srgb and texture_is_alpha from texture_flags.
+    struct PipelineVariant {
+        wgpu::TextureFormat target_format;
+        uint32_t texture_flags;
+        wgpu::RenderPipeline pipeline;
+        wgpu::Future future;
+        bool pending = false;
+        // creation failed; the registry caches the failure, so its draws use the base variant
+        bool failed = false;
+    };
+
+    // The target format the variants are created for up front.
+    static constexpr wgpu::TextureFormat default_target_format = wgpu::TextureFormat::BGRA8Unorm;
+
+    // Looks the variant up, starting its creation on a miss. Its pipeline is null until created.
+    PipelineVariant& get_variant(wgpu::TextureFormat target_format, uint32_t texture_flags);
+
+    // Hands variant to the shader watcher, if there is one.
+    void watch_variant(PipelineVariant& variant);
+
+    // The UI pipeline for module and variant, see PipelineFactory.
+    wgpu::Future create_pipeline(wgpu::ShaderModule module, wgpu::TextureFormat target_format,
+                                 uint32_t texture_flags, wgpu::CallbackMode mode,
+                                 PipelineCallback callback) const;
+
+    // Grows buffer to at least size bytes. The outgrown buffer goes back to the pool.
+    void reserve_buffer(wgpu::Buffer& buffer, wgpu::BufferUsage usage, uint64_t size,
+                        char const* label);
+
+    static uint32_t texture_handle(ImTextureID id) {
+        return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(id));
+    }
+
+    struct FrameResources {
+        wgpu::Buffer vertex_buffer;
+        wgpu::Buffer index_buffer;
+    };
+
+    // Below this many bytes the draw lists are copied on the calling thread.
+    static constexpr uint64_t parallel_upload_threshold = 256 * 1024;
+
     ImGuiContext *context;
     wgpu::Device device;
-    wgpu::RenderPipeline pipeline;
-    wgpu::BindGroup bind_groups[3];
-    wgpu::Buffer view_uniform_buffer;
-    wgpu::Buffer draw_flags_uniform_buffer;
-    wgpu::Texture font_texture;
-    uint32_t last_draw_flags;
-    wgpu::Texture* last_texture;
+    StagingBelt* belt = nullptr;
+    ObjectRegistry* registry = nullptr;
+    ResourcePool* pool = nullptr;
+    ShaderWatcher* watcher = nullptr;
+    FrameUniforms* uniforms = nullptr;
+    wgpu::BindGroupLayout pass_layout;
+    wgpu::BindGroupLayout texture_layout;
+    wgpu::PipelineLayout pipeline_layout;
+    wgpu::Sampler sampler;
+    // view info at a dynamic offset and the sampler, made on the uniforms buffer
+    wgpu::BindGroup pass_bind_group;
+    wgpu::Buffer pass_bind_group_buffer;
+    uint32_t view_info_offset = 0;
+    wgpu::ShaderModule module;
+    // a handful at most, searched linearly; pointers stay valid for the pipeline callbacks
+    std::vector<std::unique_ptr<PipelineVariant>> variants;
+    FrameResources frames[FrameTracker::max_frames_in_flight];
+    uint32_t slot = 0;
+    // view of the last end_frame() target, the same texture is drawn to every frame
+    wgpu::Texture target;
+    wgpu::TextureView target_view;
+    bool compact_vertices = false;
+    // per draw list (vertex, index) offset into the staging allocation
+    std::vector<std::pair<uint64_t, uint64_t>> list_offsets;
+    uint64_t last_upload_bytes = 0;
+    // indexed by handle, 0 is never handed out
+    std::vector<TextureEntry> textures;
+    std::vector<uint32_t> free_texture_handles;
+    ImTextureID font_texture_id = nullptr;
+    std::unique_ptr<GlyphCache> glyph_cache;
+    bool glyph_cache_changed = false;
 };
 
-class ImGuiGlfw {
+// Mouse input of the overlay, queued from the consumer's thread and fed to ImGui on the render
+// thread. Positions are normalized to the display, whose size follows the dynamic resolution.
+class ImGuiInput {
 public:
-    ~ImGuiGlfw();
+    ImGuiInput();
+
+    // Thread safe.
+    void add_mouse_pos(float x, float y);
+
+    // Thread safe. button: ImGuiMouseButton.
+    void add_mouse_button(int button, bool down);
 
+    // Thread safe. In wheel steps.
+    void add_mouse_wheel(float x, float y);
+
+    // Render thread, before ImGuiWebGPU::begin_frame(). Hands the queued events to ImGui.
+    void feed(float display_width, float display_height);
+
+    // Render thread, after feed(). False while events arrive and for a few frames after, which
+    // ImGui needs to settle hover and animation state.
     bool is_idle();
 
 private:
+    struct Event {
+        enum class Type { Pos, Button, Wheel } type;
+        float x = 0.0f;
+        float y = 0.0f;
+        int button = 0;
+        bool down = false;
+    };
+
+    std::mutex mutex;
+    // guarded by mutex, swapped with frame_events by feed()
+    std::vector<Event> events;
+    std::vector<Event> frame_events;
     int refresh_frame_count = 0;
 };
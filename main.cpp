@@ -2,294 +2,29 @@
 
 #include <QApplication>
 #include <QGuiApplication>
-#include <QImage>
-#include <QMutex>
+#include <QMouseEvent>
 #include <QObject>
 #include <QOpenGLFunctions>
-#include <QPainter>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
 #include <QQuickImageProvider>
 #include <QQuickItem>
 #include <QRunnable>
+#include <QSGSimpleTextureNode>
 #include <QTimer>
+#include <QVector2D>
+#include <QWheelEvent>
 #include <QtGui/QOpenGLContext>
 #include <QtGui/QOpenGLShaderProgram>
-#include <QtGui/QOpenGLTexture>
-#include <thread>
+#include <memory>
+#include <string_view>
 
-///// webgpu stuff
-
-#include <imgui/imgui.h>
-
-#include <cassert>
-#include <chrono>
-#include <fstream>
-#include <iomanip>
-#include <iostream>
-#include <sstream>
-#include <string>
-
-#include "imgui_helpers.h"
-#include "webgpu_helpers.h"
-
-using namespace wgpu;
-
-struct GPU {
-    Instance instance; // XXX could avoid and use adapter.GetInstance()
-    Adapter adapter; // XXX could avoid and use device.GetAdapter()
-    Device device;
-
-    void release() {
-        std::cout << "Cleaning up...\n";
-
-        device.Destroy();
-    }
-};
-
-[[nodiscard]] GPU init_webgpu() {
-    GPU gpu{};
-    gpu.instance = CreateInstance();
-
-    RequestAdapterOptions options = {
-        .compatibleSurface = nullptr,
-        .powerPreference = PowerPreference::HighPerformance,
-        .forceFallbackAdapter = false,
-        .compatibilityMode = false,
-    };
-    FutureWaitInfo adapter_future;
-    adapter_future.future = gpu.instance.RequestAdapter(&options, CallbackMode::WaitAnyOnly,
-        [&gpu] (RequestAdapterStatus status, Adapter adapter, char const* message) {
-            assert(status == RequestAdapterStatus::Success);
-            gpu.adapter = adapter;
-    });
-
-    auto status = gpu.instance.WaitAny(1, &adapter_future, 0);
-    if (status == WaitStatus::Success && adapter_future.completed) {
-        DeviceDescriptor options;
-        options.deviceLostCallbackInfo = {
-                .callback = [](WGPUDevice const * device, WGPUDeviceLostReason reason, char const * message, void *) {
-                    std::cout << "Device Lost: " << message << "\n";
-                },
-        };
-        options.uncapturedErrorCallbackInfo = {
-                .callback = [](WGPUErrorType type, char const * message, void *) {
-                    std::cout << "Error: " << message << "\n";
-                },
-        };
-        FutureWaitInfo device_future;
-        device_future.future = gpu.adapter.RequestDevice(&options, CallbackMode::WaitAnyOnly,
-            [&gpu](RequestDeviceStatus status, Device device, char const* msg) {
-                assert(status == RequestDeviceStatus::Success);
-                gpu.device = device;
-            });
-        auto status = gpu.instance.WaitAny(1, &device_future, 0);
-        if (status == WaitStatus::Success && device_future.completed) {
-        }
-    }
-
-    return gpu;
-}
-
-
-static const char shader_code[] = R"WGSL(
-    @vertex fn vertexMain(@builtin(vertex_index) i : u32) ->
-      @builtin(position) vec4f {
-        const pos = array(vec2f(0, 1), vec2f(-1, -1), vec2f(1, -1));
-        return vec4f(pos[i], 0, 1);
-    }
-
-    @fragment fn fragmentMain() -> @location(0) vec4f {
-        return vec4f(1, 0, 0, 1);
-    }
-)WGSL";
-
-
-int webgpu_main() {
-  
-
-    auto gpu = init_webgpu();
-
-    ImGuiWebGPU imgui(gpu.device);
-
-
-    ShaderModuleWGSLDescriptor wgsl_desc;
-    wgsl_desc.code = shader_code;
-
-    ShaderModuleDescriptor shader_desc{
-        .nextInChain = &wgsl_desc,
-    };
-
-    ShaderModule shader_module = gpu.device.CreateShaderModule(&shader_desc);
-
-    ColorTargetState color_target_state{
-        .format = TextureFormat::BGRA8Unorm
-    };
-
-    FragmentState fragment_state{
-        .module = shader_module,
-        .targetCount = 1,
-        .targets = &color_target_state
-    };
-
-    RenderPipelineDescriptor descriptor{
-        .vertex = { .module = shader_module },
-        .fragment = &fragment_state
-    };
-    RenderPipeline pipeline = gpu.device.CreateRenderPipeline(&descriptor);
-
-    int width, height;
-width = 800;
-height = 600;
-    TextureCapture capture(gpu.device);
-    
-    TextureDescriptor textureDesc;
-    textureDesc.size.width = 1024; 
-    textureDesc.size.height = 768;
-    textureDesc.size.depthOrArrayLayers = 1;
-    textureDesc.mipLevelCount = 1;
-    textureDesc.sampleCount = 1;
-    textureDesc.dimension = TextureDimension::e2D;
-    textureDesc.format = TextureFormat::BGRA8Unorm;
-    textureDesc.usage = TextureUsage::RenderAttachment | TextureUsage::CopySrc;
-
-Texture texture = gpu.device.CreateTexture(&textureDesc);
-
-TextureView textureView = texture.CreateView();
-bool keep_rendering = true;
-    while (keep_rendering) {
-        std::vector<CommandBuffer> commands;
-
-
-        RenderPassColorAttachment attachment{
-            .view = textureView,
-            .loadOp = LoadOp::Clear,
-            .storeOp = StoreOp::Store
-        };
-
-        RenderPassDescriptor render_pass{
-            .colorAttachmentCount = 1,
-            .colorAttachments = &attachment
-        };
-
-        CommandEncoder encoder = gpu.device.CreateCommandEncoder();
-        RenderPassEncoder pass = encoder.BeginRenderPass(&render_pass);
-        pass.SetPipeline(pipeline);
-        pass.Draw(3);
-        pass.End();
-
-        commands.push_back(encoder.Finish());
-        gpu.device.GetQueue().Submit(commands.size(), commands.data());
-
-        imgui.begin_frame(texture.GetWidth(), texture.GetHeight());
-
-        // simple fps counter
-        static int frame_count = 0;
-        static auto prev = std::chrono::high_resolution_clock::now();
-        static float mean_fps = 0.0;
-        if (frame_count >= 60) {
-            auto now = std::chrono::high_resolution_clock::now();
-            std::chrono::duration<double, std::micro> mean_us = now - prev;
-            mean_fps = float(frame_count) / (mean_us.count() * 1e-6);
-            prev = now;
-            frame_count = 1;
-        } else {
-            frame_count++;
-        }
-
-        ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav;
-        window_flags |= ImGuiWindowFlags_NoMove;
-
-        const float PAD = 10.0f;
-        const ImGuiViewport* viewport = ImGui::GetMainViewport();
-        ImVec2 work_pos = viewport->WorkPos; // Use work area to avoid menu-bar/task-bar, if any!
-        ImVec2 work_size = viewport->WorkSize;
-        ImVec2 window_pos, window_pos_pivot;
-        window_pos.x = work_pos.x + PAD;
-        window_pos.y = work_pos.y + PAD;
-        window_pos_pivot.x = 0.0f;
-        window_pos_pivot.y = 0.0f;
-        ImGui::SetNextWindowPos(window_pos, ImGuiCond_Always, window_pos_pivot);
-
-        static std::stringstream capture_file_name;
-        static int capture_seq = 0;
-        static int capture_frame = 0;
-        static bool do_capture = true;
-        static bool capture_include_ui = false;
-        if (ImGui::Begin("Example: Simple overlay", nullptr, window_flags)) {
-            ImGui::Text("[F1] Open/Close demo window");
-            ImGui::Text("Fps: %.1f", mean_fps);
-            const char * capture_btn_labels[2] = { "Screen capture", "Stop capture" };
-            const ImVec4 capture_btn_colors[2] = { ImGui::GetStyleColorVec4(ImGuiCol_Button), (ImVec4)ImColor::HSV(0.0f, 0.6f, 0.6f) };
-            const ImVec4 capture_btn_hovered_colors[2] = { ImGui::GetStyleColorVec4(ImGuiCol_ButtonHovered), (ImVec4)ImColor::HSV(0.0f, 0.6f, 0.8f) };
-            const ImVec4 capture_btn_active_colors[2] = { ImGui::GetStyleColorVec4(ImGuiCol_ButtonActive), (ImVec4)ImColor::HSV(0.0f, 0.6f, 1.0f) };
-            ImGui::PushStyleColor(ImGuiCol_Button, capture_btn_colors[do_capture]);
-            ImGui::PushStyleColor(ImGuiCol_ButtonHovered, capture_btn_hovered_colors[do_capture]);
-            ImGui::PushStyleColor(ImGuiCol_ButtonActive, capture_btn_active_colors[do_capture]);
-            if (ImGui::Button(capture_btn_labels[do_capture])) {
-                do_capture = !do_capture;
-                if (do_capture) {
-                    capture_seq = (capture_seq + 1) % 100;
-                    capture_frame = 0;
-                }
-            }
-            ImGui::PopStyleColor(3);
-            ImGui::SameLine();
-            ImGui::Checkbox("/w UI", &capture_include_ui);
-
-            if (do_capture) {
-                capture_file_name.str("");
-                capture_file_name << "capture_s" << std::setfill('0') << std::setw(2) << capture_seq
-                    << "_" << std::setw(5) << capture_frame << ".ppm";
-                ImGui::Text("%s", capture_file_name.str().c_str());
-                capture_frame = (capture_frame + 1) % 10000;
-            }
-        }
-        ImGui::End();
-
-        if (capture_include_ui) {
-            imgui.end_frame(texture);
-        }
-
-        if (do_capture) {
-            std::string file_name = capture_file_name.str();
-            capture.push(texture, nullptr,
-                [file_name](char const * image_data, ImageDataLayout const& layout) {
-                std::ofstream file(file_name);
-                file << "P6\n" << layout.width << " " << layout.height << "\n" << 255 << "\n";
-                for (int row = 0; row <layout.height; row++) {
-                        char const * pixel = image_data + row * layout.row_stride;
-                        for (int col = 0; col <layout.width; col++, pixel += 4) {
-                            if (layout.format == TextureFormat::BGRA8Unorm) {
-                                char rgb[3] = { *(pixel + 2), *(pixel + 1), *pixel };
-                                file.write(rgb, 3);
-                            } else {
-                                file.write(pixel, 3);
-                            }
-                    }
-                }
-            });
-        }
-
-        if (!capture_include_ui) {
-            imgui.end_frame(texture);
-        }
-
-        // Poll for and process events
-        gpu.instance.ProcessEvents();
-
-        if (do_capture) {
-            capture.pop();
-        }
-
-    }
-
-    gpu.release();
-
-    return 0;
-}
-///// webgpu stuff
+#include "bench.h"
+#include "gl_shared_frames.h"
+#include "render_service.h"
 
+// Raw GL fallback: draws through beforeRenderPassRecording and resets the GL state on every
+// paint. Only used when TextureCanvas.rawGL is set.
 class TextureCanvasRenderer : public QObject, protected QOpenGLFunctions {
     Q_OBJECT
    public:
@@ -302,23 +37,19 @@ class TextureCanvasRenderer : public QObject, protected QOpenGLFunctions {
     void setT(qreal t) {
         m_t = t;
     }
-    void setViewportSize(const QSize &size) {
-        m_viewportSize = size;
+    // the item's rect in window pixels, bottom left origin
+    void setViewport(const QRect &viewport) {
+        m_viewport = viewport;
     }
     void setWindow(QQuickWindow *window) {
         m_window = window;
     }
-
-    void updateTextureData() {
-        if (m_texture != NULL) {
-            m_texture->destroy();
-            m_texture = NULL;
-        }
-        if (!m_image->isNull()) {
-            m_texture = new QOpenGLTexture(m_image->mirrored());
-            m_texture->setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
-            m_texture->setMagnificationFilter(QOpenGLTexture::Linear);
-            m_texture->setWrapMode(QOpenGLTexture::Repeat);
+    // texture: a shared frame, its content the top left frameSize texels
+    void setFrame(GLuint texture, QSize textureSize, QSize frameSize) {
+        m_texture = texture;
+        if (texture != 0) {
+            m_scale = QVector2D(float(frameSize.width()) / textureSize.width(),
+                                float(frameSize.height()) / textureSize.height());
         }
     }
 
@@ -334,10 +65,12 @@ class TextureCanvasRenderer : public QObject, protected QOpenGLFunctions {
             m_program = new QOpenGLShaderProgram();
             m_program->addCacheableShaderFromSourceCode(
                 QOpenGLShader::Vertex,
+                "uniform highp vec2 scale;"
                 "varying highp vec2 coords;"
                 "void main() {"
                 "vec3 position = vec3(vec2(gl_VertexID % 2, gl_VertexID / 2) * 4.0 - 1.0, 0.0);"
-                "coords = (position.xy + 1.0) * 0.5;"
+                // the frame's first row is on top
+                "coords = vec2(position.x + 1.0, 1.0 - position.y) * 0.5 * scale;"
                 "gl_Position = vec4(position, 1.0);"
                 "}");
             m_program->addCacheableShaderFromSourceCode(
@@ -350,16 +83,6 @@ class TextureCanvasRenderer : public QObject, protected QOpenGLFunctions {
                 "}");
 
             m_program->link();
-
-            m_image = new QImage(400, 400, QImage::Format_RGBA8888);
-            m_image->fill(Qt::red);
-            QPainter painter(m_image);
-            painter.setPen(Qt::blue);
-            painter.setBrush(Qt::NoBrush);
-            painter.drawRect(25, 25, 50, 50);
-            painter.end();
-
-            updateTextureData();
         }
     }
     void paint() {
@@ -372,13 +95,14 @@ class TextureCanvasRenderer : public QObject, protected QOpenGLFunctions {
         glBindBuffer(GL_ARRAY_BUFFER, 0);
 
         m_program->setUniformValue("t", (float)m_t);
+        m_program->setUniformValue("scale", m_scale);
 
-        glViewport(0, 0, m_viewportSize.width(), m_viewportSize.height());
+        glViewport(m_viewport.x(), m_viewport.y(), m_viewport.width(), m_viewport.height());
 
         glDisable(GL_DEPTH_TEST);
 
-        if (m_texture != NULL) {
-            m_texture->bind();
+        if (m_texture != 0) {
+            glBindTexture(GL_TEXTURE_2D, m_texture);
         }
         glDrawArrays(GL_TRIANGLES, 0, 3);
 
@@ -391,12 +115,12 @@ class TextureCanvasRenderer : public QObject, protected QOpenGLFunctions {
     }
 
    private:
-    QSize m_viewportSize;
+    QRect m_viewport;
     qreal m_t;
     QOpenGLShaderProgram *m_program;
     QQuickWindow *m_window;
-    QImage *m_image;
-    QOpenGLTexture *m_texture = NULL;
+    GLuint m_texture = 0;
+    QVector2D m_scale;
 };
 
 class CleanupJob : public QRunnable {
@@ -411,14 +135,51 @@ class CleanupJob : public QRunnable {
     TextureCanvasRenderer *m_renderer;
 };
 
+// Deletes the imports of a view's frames on the scene graph render thread.
+class ReleaseFramesJob : public QRunnable {
+   public:
+    ReleaseFramesJob(std::shared_ptr<GLSharedFrames> frames) : m_frames(std::move(frames)) {
+    }
+    void run() override {
+        m_frames->release();
+    }
+
+   private:
+    std::shared_ptr<GLSharedFrames> m_frames;
+};
+
 class TextureCanvas : public QQuickItem {
     Q_OBJECT
     Q_PROPERTY(qreal t READ t WRITE setT NOTIFY tChanged)
+    Q_PROPERTY(bool rawGL READ rawGL WRITE setRawGL NOTIFY rawGLChanged)
+    // GPU bring up runs in the background, the canvas stays empty until it is ready
+    Q_PROPERTY(bool gpuReady READ gpuReady NOTIFY gpuStatusChanged)
+    Q_PROPERTY(bool gpuFailed READ gpuFailed NOTIFY gpuStatusChanged)
     QML_ELEMENT
 
    public:
-    TextureCanvas() : m_t(0), m_renderer(nullptr) {
+    TextureCanvas() : m_t(0), m_rawGL(false), m_renderer(nullptr) {
+        setFlag(ItemHasContents, true);
+        // for the overlay, see RenderService::overlay_mouse_pos()
+        setAcceptedMouseButtons(Qt::LeftButton | Qt::RightButton | Qt::MiddleButton);
+        setAcceptHoverEvents(true);
         connect(this, &QQuickItem::windowChanged, this, &TextureCanvas::handleWindowChanged);
+        m_view = RenderService::instance().add_view(
+            [this](SharedFrame const &frame) { receiveFrame(frame); },
+            [this](RenderStatus status) {
+                QMetaObject::invokeMethod(this, [this, status] { setGpuStatus(status); },
+                                          Qt::QueuedConnection);
+            });
+        // no frame arrives before the first update_view()
+        m_frames = std::make_shared<GLSharedFrames>(RenderService::instance(), m_view);
+        m_gpuStatus = RenderService::instance().get_status();
+    }
+    ~TextureCanvas() {
+        RenderService::instance().remove_view(m_view);
+        if (window()) {
+            window()->scheduleRenderJob(new ReleaseFramesJob(m_frames),
+                                        QQuickWindow::NoStage);
+        }
     }
 
     qreal t() const {
@@ -428,14 +189,44 @@ class TextureCanvas : public QQuickItem {
         if (t == m_t) return;
         m_t = t;
         emit tChanged();
-        if (window()) window()->update();
+        scheduleRepaint();
+    }
+
+    bool rawGL() const {
+        return m_rawGL;
+    }
+    void setRawGL(bool rawGL) {
+        if (rawGL == m_rawGL) return;
+        m_rawGL = rawGL;
+        setFlag(ItemHasContents, !m_rawGL);
+        emit rawGLChanged();
+        update();
+    }
+
+    bool gpuReady() const {
+        return m_gpuStatus == RenderStatus::Ready;
+    }
+    bool gpuFailed() const {
+        return m_gpuStatus == RenderStatus::Failed;
     }
 
    signals:
     void tChanged();
+    void rawGLChanged();
+    void gpuStatusChanged();
 
    public slots:
     void sync() {
+        if (!m_rawGL) {
+            if (m_renderer) {
+                // switched back to the retained path, stop painting underneath the texture node
+                disconnect(window(), nullptr, m_renderer, nullptr);
+                window()->scheduleRenderJob(new CleanupJob(m_renderer),
+                                            QQuickWindow::BeforeSynchronizingStage);
+                m_renderer = nullptr;
+            }
+            return;
+        }
         if (!m_renderer) {
             m_renderer = new TextureCanvasRenderer();
             connect(window(), &QQuickWindow::beforeRendering, m_renderer,
@@ -443,16 +234,95 @@ class TextureCanvas : public QQuickItem {
             connect(window(), &QQuickWindow::beforeRenderPassRecording, m_renderer,
                     &TextureCanvasRenderer::paint, Qt::DirectConnection);
         }
-        m_renderer->setViewportSize(window()->size() * window()->devicePixelRatio());
+        // the item's pixel size like the retained path, drawn over the item's rect only
+        qreal ratio = window()->effectiveDevicePixelRatio();
+        QSize pixel_size = (size() * ratio).toSize();
+        RenderService::instance().update_view(m_view, pixel_size.width(), pixel_size.height(),
+                                              m_t);
+        QPointF top_left = mapToScene(QPointF(0, 0)) * ratio;
+        int window_height = qRound(window()->height() * ratio);
+        m_renderer->setViewport(QRect(qRound(top_left.x()),
+                                      window_height - qRound(top_left.y()) - pixel_size.height(),
+                                      pixel_size.width(), pixel_size.height()));
         m_renderer->setT(m_t);
         m_renderer->setWindow(window());
+
+        m_frames->update();
+        m_renderer->setFrame(m_frames->texture(), m_frames->textureSize(), m_frames->frameSize());
     }
     void cleanup() {
         delete m_renderer;
         m_renderer = nullptr;
+        m_frames->release();
+    }
+
+   protected:
+    // Retained path: the shared texture rendered by the RenderService is wrapped in a QSGTexture,
+    // without a copy, and drawn by a regular texture node, so Qt Quick batches it like any other
+    // item.
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *) override {
+        auto *node = static_cast<QSGSimpleTextureNode *>(oldNode);
+        if (m_rawGL) {
+            delete node;
+            return nullptr;
+        }
+
+        QSize pixel_size = (size() * window()->effectiveDevicePixelRatio()).toSize();
+        if (pixel_size.isEmpty()) {
+            delete node;
+            return nullptr;
+        }
+
+        RenderService::instance().update_view(m_view, pixel_size.width(), pixel_size.height(),
+                                              m_t);
+
+        bool shown = m_frames->update();
+        if (!node && m_frames->texture() == 0) {
+            // nothing rendered yet
+            return nullptr;
+        }
+        if (!node) {
+            node = new QSGSimpleTextureNode();
+            // wrapped once per shared buffer, owned by m_frames
+            node->setOwnsTexture(false);
+            node->setFiltering(QSGTexture::Linear);
+        }
+        if (shown || !node->texture()) {
+            node->setTexture(m_frames->sceneGraphTexture(window()));
+            // the render size follows the dynamic resolution, the targets only grow in steps
+            node->setSourceRect(QRectF(QPointF(0, 0), m_frames->frameSize()));
+        }
+        node->setRect(boundingRect());
+        return node;
+    }
+
+    void mousePressEvent(QMouseEvent *event) override {
+        forwardMouseButton(event, true);
+    }
+    void mouseReleaseEvent(QMouseEvent *event) override {
+        forwardMouseButton(event, false);
+    }
+    void mouseMoveEvent(QMouseEvent *event) override {
+        forwardMousePos(event->localPos());
+    }
+    void hoverMoveEvent(QHoverEvent *event) override {
+        forwardMousePos(event->posF());
+    }
+    void wheelEvent(QWheelEvent *event) override {
+        // 120 per wheel step
+        QPointF steps = QPointF(event->angleDelta()) / 120.0;
+        RenderService::instance().overlay_mouse_wheel(m_view, steps.x(), steps.y());
     }
 
    private slots:
+    void scheduleRepaint() {
+        if (m_rawGL) {
+            if (window()) window()->update();
+        } else {
+            update();
+        }
+    }
+
     void handleWindowChanged(QQuickWindow *win) {
         if (win) {
             connect(win, &QQuickWindow::beforeSynchronizing, this, &TextureCanvas::sync,
@@ -464,27 +334,93 @@ class TextureCanvas : public QQuickItem {
     }
 
    private:
-    void releaseResources() {
-        window()->scheduleRenderJob(new CleanupJob(m_renderer),
-                                    QQuickWindow::BeforeSynchronizingStage);
+    void setGpuStatus(RenderStatus status) {
+        if (status == m_gpuStatus) return;
+        m_gpuStatus = status;
+        emit gpuStatusChanged();
+    }
+
+    // The overlay draws at the render size, which follows the dynamic resolution.
+    void forwardMousePos(QPointF pos) {
+        if (width() <= 0 || height() <= 0) return;
+        RenderService::instance().overlay_mouse_pos(m_view, pos.x() / width(), pos.y() / height());
+    }
+    void forwardMouseButton(QMouseEvent *event, bool down) {
+        // ImGuiMouseButton
+        int button = event->button() == Qt::LeftButton    ? 0
+                     : event->button() == Qt::RightButton ? 1
+                                                          : 2;
+        forwardMousePos(event->localPos());
+        RenderService::instance().overlay_mouse_button(m_view, button, down);
+    }
+
+    // Called on the WebGPU render thread with each frame of our view, a dma-buf the scene graph
+    // imports on its render thread.
+    void receiveFrame(SharedFrame const &frame) {
+        m_frames->receive(frame);
+        QMetaObject::invokeMethod(this, "scheduleRepaint", Qt::QueuedConnection);
+    }
+
+    void releaseResources() override {
+        if (m_renderer) {
+            window()->scheduleRenderJob(new CleanupJob(m_renderer),
+                                        QQuickWindow::BeforeSynchronizingStage);
+        }
         m_renderer = nullptr;
+        if (window()) {
+            window()->scheduleRenderJob(new ReleaseFramesJob(m_frames), QQuickWindow::NoStage);
+        }
     }
 
     qreal m_t;
+    bool m_rawGL;
     TextureCanvasRenderer *m_renderer;
+    ViewId m_view;
+    RenderStatus m_gpuStatus;
+    // shared with the render jobs that delete its imports
+    std::shared_ptr<GLSharedFrames> m_frames;
 };
 
 int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (std::string_view(argv[i]) == "--bench-views") {
+            return run_view_benchmark(64);
+        }
+        if (std::string_view(argv[i]) == "--dynamic-resolution") {
+            RenderService::instance().set_dynamic_resolution(true, 8.0);
+        }
+        if (std::string_view(argv[i]) == "--bench-ui-vertices") {
+            return run_ui_vertex_benchmark(200);
+        }
+        if (std::string_view(argv[i]) == "--compact-ui-vertices") {
+            RenderService::instance().set_compact_ui_vertices(true);
+        }
+        if (std::string_view(argv[i]) == "--watch-shaders") {
+            RenderService::instance().set_shader_directory(SHADER_SOURCE_DIR);
+        }
+        if (std::string_view(argv[i]) == "--font" && i + 1 < argc) {
+            RenderService::instance().set_ui_font(argv[++i], 16.0f);
+        }
+    }
+
+    // the shared frames are imported through EGL, X11 defaults to GLX
+    if (qEnvironmentVariableIsEmpty("QT_XCB_GL_INTEGRATION")) {
+        qputenv("QT_XCB_GL_INTEGRATION", "xcb_egl");
+    }
     QApplication app(argc, argv);
 
-    std::thread t(webgpu_main);
+    // adapter, device and pipelines are created on the render thread while QML loads
+    RenderService::instance().start();
 
     QQmlApplicationEngine engine;
 
     qmlRegisterType<TextureCanvas>("CustomComponents", 1, 0, "TextureCanvas");
 
     engine.load(QUrl(QStringLiteral("qrc:/main.qml")));
-    return app.exec();
+    int result = app.exec();
+
+    RenderService::instance().stop();
+    return result;
 }
 
 #include "main.moc"
\ No newline at end of file
@@ -19,8 +19,16 @@ ApplicationWindow {
         }
 
         TextureCanvas {
+            id: canvas
             width: 400
             height: 400
+
+            Text {
+                anchors.centerIn: parent
+                visible: !canvas.gpuReady
+                color: "white"
+                text: canvas.gpuFailed ? qsTr("No WebGPU device") : qsTr("Starting GPU...")
+            }
         }
     }
 }
\ No newline at end of file
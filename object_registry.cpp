@@ -0,0 +1,299 @@
+#include "object_registry.h"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+using namespace wgpu;
+
+void ObjectRegistry::Key::add_string(char const* text) {
+    uint64_t size = text ? std::strlen(text) : ~0ull;
+    add(size);
+    if (text) {
+        this->bytes.append(text, size);
+    }
+}
+
+ObjectRegistry::ObjectRegistry(Device device) : device(device) {
+    AdapterInfo info;
+    device.GetAdapter().GetInfo(&info);
+    this->backend = info.backendType;
+}
+
+ObjectRegistry::~ObjectRegistry() {
+    std::vector<FutureWaitInfo> pending;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        for (auto& [key, entry] : this->render_pipelines) {
+            if (entry.pending) {
+                pending.push_back({.future = entry.future});
+            }
+        }
+    }
+    Instance instance = this->device.GetAdapter().GetInstance();
+    for (FutureWaitInfo& wait_info : pending) {
+        instance.WaitAny(1, &wait_info, UINT64_MAX);
+    }
+}
+
+ShaderModule ObjectRegistry::get_shader_module(EmbeddedShader const& shader) {
+    Key key;
+    key.add_string(shader.name);
+    key.add_string(shader.wgsl);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto [it, inserted] = this->shader_modules.try_emplace(std::move(key.bytes));
+    if (inserted) {
+        it->second = create_shader_module(this->device, this->backend, shader);
+        this->registered_modules.insert(static_cast<void const*>(it->second.Get()));
+    } else {
+        this->hits++;
+    }
+    return it->second;
+}
+
+Sampler ObjectRegistry::get_sampler(SamplerDescriptor const& descriptor) {
+    assert(!descriptor.nextInChain);
+    Key key;
+    key.add(descriptor.addressModeU);
+    key.add(descriptor.addressModeV);
+    key.add(descriptor.addressModeW);
+    key.add(descriptor.magFilter);
+    key.add(descriptor.minFilter);
+    key.add(descriptor.mipmapFilter);
+    key.add(descriptor.lodMinClamp);
+    key.add(descriptor.lodMaxClamp);
+    key.add(descriptor.compare);
+    key.add(descriptor.maxAnisotropy);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto [it, inserted] = this->samplers.try_emplace(std::move(key.bytes));
+    if (inserted) {
+        it->second = this->device.CreateSampler(&descriptor);
+    } else {
+        this->hits++;
+    }
+    return it->second;
+}
+
+BindGroupLayout ObjectRegistry::get_bind_group_layout(BindGroupLayoutDescriptor const& descriptor) {
+    assert(!descriptor.nextInChain);
+    Key key;
+    key.add(descriptor.entryCount);
+    for (size_t i = 0; i < descriptor.entryCount; i++) {
+        BindGroupLayoutEntry const& entry = descriptor.entries[i];
+        assert(!entry.nextInChain);
+        key.add(entry.binding);
+        key.add(entry.visibility);
+        key.add(entry.buffer.type);
+        key.add(entry.buffer.hasDynamicOffset);
+        key.add(entry.buffer.minBindingSize);
+        key.add(entry.sampler.type);
+        key.add(entry.texture.sampleType);
+        key.add(entry.texture.viewDimension);
+        key.add(entry.texture.multisampled);
+        key.add(entry.storageTexture.access);
+        key.add(entry.storageTexture.format);
+        key.add(entry.storageTexture.viewDimension);
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto [it, inserted] = this->bind_group_layouts.try_emplace(std::move(key.bytes));
+    if (inserted) {
+        it->second = this->device.CreateBindGroupLayout(&descriptor);
+    } else {
+        this->hits++;
+    }
+    return it->second;
+}
+
+PipelineLayout ObjectRegistry::get_pipeline_layout(PipelineLayoutDescriptor const& descriptor) {
+    assert(!descriptor.nextInChain);
+    Key key;
+    key.add(descriptor.bindGroupLayoutCount);
+    for (size_t i = 0; i < descriptor.bindGroupLayoutCount; i++) {
+        key.add_object(descriptor.bindGroupLayouts[i]);
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto [it, inserted] = this->pipeline_layouts.try_emplace(std::move(key.bytes));
+    if (inserted) {
+        it->second = this->device.CreatePipelineLayout(&descriptor);
+    } else {
+        this->hits++;
+    }
+    return it->second;
+}
+
+void ObjectRegistry::add_constants(Key& key, size_t count, ConstantEntry const* constants) {
+    key.add(count);
+    for (size_t i = 0; i < count; i++) {
+        key.add_string(constants[i].key);
+        key.add(constants[i].value);
+    }
+}
+
+ObjectRegistry::Key ObjectRegistry::render_pipeline_key(RenderPipelineDescriptor const& descriptor) {
+    assert(!descriptor.nextInChain && !descriptor.primitive.nextInChain);
+    // auto layouts would give every pipeline its own bind group layouts
+    assert(descriptor.layout);
+    Key key;
+    key.add_object(descriptor.layout);
+
+    VertexState const& vertex = descriptor.vertex;
+    key.add_object(vertex.module);
+    key.add_string(vertex.entryPoint);
+    add_constants(key, vertex.constantCount, vertex.constants);
+    key.add(vertex.bufferCount);
+    for (size_t i = 0; i < vertex.bufferCount; i++) {
+        VertexBufferLayout const& buffer = vertex.buffers[i];
+        key.add(buffer.arrayStride);
+        key.add(buffer.stepMode);
+        key.add(buffer.attributeCount);
+        for (size_t j = 0; j < buffer.attributeCount; j++) {
+            key.add(buffer.attributes[j].format);
+            key.add(buffer.attributes[j].offset);
+            key.add(buffer.attributes[j].shaderLocation);
+        }
+    }
+
+    key.add(descriptor.primitive.topology);
+    key.add(descriptor.primitive.stripIndexFormat);
+    key.add(descriptor.primitive.frontFace);
+    key.add(descriptor.primitive.cullMode);
+
+    key.add(descriptor.depthStencil != nullptr);
+    if (DepthStencilState const* depth_stencil = descriptor.depthStencil) {
+        key.add(depth_stencil->format);
+        key.add(depth_stencil->depthWriteEnabled);
+        key.add(depth_stencil->depthCompare);
+        for (StencilFaceState const* face : {&depth_stencil->stencilFront, &depth_stencil->stencilBack}) {
+            key.add(face->compare);
+            key.add(face->failOp);
+            key.add(face->depthFailOp);
+            key.add(face->passOp);
+        }
+        key.add(depth_stencil->stencilReadMask);
+        key.add(depth_stencil->stencilWriteMask);
+        key.add(depth_stencil->depthBias);
+        key.add(depth_stencil->depthBiasSlopeScale);
+        key.add(depth_stencil->depthBiasClamp);
+    }
+
+    key.add(descriptor.multisample.count);
+    key.add(descriptor.multisample.mask);
+    key.add(descriptor.multisample.alphaToCoverageEnabled);
+
+    key.add(descriptor.fragment != nullptr);
+    if (FragmentState const* fragment = descriptor.fragment) {
+        key.add_object(fragment->module);
+        key.add_string(fragment->entryPoint);
+        add_constants(key, fragment->constantCount, fragment->constants);
+        key.add(fragment->targetCount);
+        for (size_t i = 0; i < fragment->targetCount; i++) {
+            ColorTargetState const& target = fragment->targets[i];
+            key.add(target.format);
+            key.add(target.writeMask);
+            key.add(target.blend != nullptr);
+            if (target.blend) {
+                for (BlendComponent const* component : {&target.blend->color, &target.blend->alpha}) {
+                    key.add(component->operation);
+                    key.add(component->srcFactor);
+                    key.add(component->dstFactor);
+                }
+            }
+        }
+    }
+    return key;
+}
+
+bool ObjectRegistry::has_registered_modules(RenderPipelineDescriptor const& descriptor) const {
+    auto registered = [this](ShaderModule const& module) {
+        return this->registered_modules.contains(static_cast<void const*>(module.Get()));
+    };
+    return registered(descriptor.vertex.module) &&
+           (!descriptor.fragment || registered(descriptor.fragment->module));
+}
+
+Future ObjectRegistry::create_render_pipeline(RenderPipelineDescriptor const& descriptor,
+                                              CallbackMode mode, PipelineCallback callback) {
+    return this->device.CreateRenderPipelineAsync(
+        &descriptor, mode,
+        [callback = std::move(callback), label = std::string(descriptor.label ? descriptor.label : "")](
+            CreatePipelineAsyncStatus status, RenderPipeline pipeline, char const* message) {
+            if (status != CreatePipelineAsyncStatus::Success) {
+                std::cout << "Pipeline " << label << " error: " << status << ": " << message << "\n";
+                pipeline = nullptr;
+            }
+            callback(pipeline);
+        });
+}
+
+Future ObjectRegistry::get_render_pipeline(RenderPipelineDescriptor const& descriptor,
+                                           CallbackMode mode, PipelineCallback callback) {
+    // the callback must not run inside CreateRenderPipelineAsync, the lock is held there
+    assert(mode != CallbackMode::AllowSpontaneous);
+    Key key = render_pipeline_key(descriptor);
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    if (!has_registered_modules(descriptor)) {
+        // a reloaded module is replaced by the next reload, its key would never be asked for again
+        lock.unlock();
+        return create_render_pipeline(descriptor, mode, std::move(callback));
+    }
+    auto [it, inserted] = this->render_pipelines.try_emplace(key.bytes);
+    PipelineEntry& entry = it->second;
+    if (!inserted) {
+        this->hits++;
+        if (entry.pending) {
+            entry.callbacks.push_back(std::move(callback));
+            return entry.future;
+        }
+        RenderPipeline pipeline = entry.pipeline;
+        Future future = entry.future;
+        lock.unlock();
+        callback(pipeline);
+        return future;
+    }
+
+    entry.callbacks.push_back(std::move(callback));
+    entry.future = this->device.CreateRenderPipelineAsync(
+        &descriptor, mode,
+        [this, key = std::move(key.bytes), label = std::string(descriptor.label ? descriptor.label : "")](
+            CreatePipelineAsyncStatus status, RenderPipeline pipeline, char const* message) {
+            if (status != CreatePipelineAsyncStatus::Success) {
+                std::cout << "Pipeline " << label << " error: " << status << ": " << message << "\n";
+                pipeline = nullptr;
+            }
+            std::vector<PipelineCallback> callbacks;
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                auto it = this->render_pipelines.find(key);
+                callbacks = std::move(it->second.callbacks);
+                if (pipeline) {
+                    it->second.pipeline = pipeline;
+                    it->second.pending = false;
+                } else {
+                    // the next request tries again
+                    this->render_pipelines.erase(it);
+                }
+            }
+            for (PipelineCallback& callback : callbacks) {
+                callback(pipeline);
+            }
+        });
+    return entry.future;
+}
+
+ObjectRegistry::Stats ObjectRegistry::get_stats() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return {
+        .shader_modules = static_cast<uint32_t>(this->shader_modules.size()),
+        .samplers = static_cast<uint32_t>(this->samplers.size()),
+        .bind_group_layouts = static_cast<uint32_t>(this->bind_group_layouts.size()),
+        .pipeline_layouts = static_cast<uint32_t>(this->pipeline_layouts.size()),
+        .render_pipelines = static_cast<uint32_t>(this->render_pipelines.size()),
+        .hits = this->hits,
+    };
+}
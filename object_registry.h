@@ -0,0 +1,109 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "shader_watcher.h"
+#include "shaders.h"
+
+// Hash-consing of immutable GPU objects: descriptors with the same content return the same object,
+// so creation is O(unique descriptors) however often a descriptor is asked for, and bind groups
+// made against a registered layout work with every pipeline built on it. Descriptors are keyed by
+// their content; labels are not part of the key, the first one wins. Objects referenced by a
+// descriptor (layouts, modules) are keyed by handle, they should come from the registry too.
+// Entries live as long as the registry. Pipelines of modules created elsewhere (hot reloaded
+// shaders) are created but not kept, each reload would leave its pipelines behind for good.
+// Thread safe, shaders are reloaded on another thread.
+class ObjectRegistry {
+public:
+    struct Stats {
+        uint32_t shader_modules = 0;
+        uint32_t samplers = 0;
+        uint32_t bind_group_layouts = 0;
+        uint32_t pipeline_layouts = 0;
+        uint32_t render_pipelines = 0;
+        // requests answered with an existing object, or joined to a pending creation
+        uint32_t hits = 0;
+    };
+
+    explicit ObjectRegistry(wgpu::Device device);
+
+    // Waits for the pending pipelines, their callbacks reference the registry.
+    ~ObjectRegistry();
+
+    wgpu::ShaderModule get_shader_module(EmbeddedShader const& shader);
+
+    wgpu::Sampler get_sampler(wgpu::SamplerDescriptor const& descriptor = {});
+
+    wgpu::BindGroupLayout get_bind_group_layout(wgpu::BindGroupLayoutDescriptor const& descriptor);
+
+    wgpu::PipelineLayout get_pipeline_layout(wgpu::PipelineLayoutDescriptor const& descriptor);
+
+    // CreateRenderPipelineAsync, deduplicated. A pipeline created before is passed to callback
+    // right away; a request for one still being created joins it and completes with it, whatever
+    // mode it asked for. Failed creations are not kept. The returned future may be waited on in
+    // both cases. Descriptors with a module that is not from get_shader_module() are passed
+    // through to CreateRenderPipelineAsync.
+    wgpu::Future get_render_pipeline(wgpu::RenderPipelineDescriptor const& descriptor,
+                                     wgpu::CallbackMode mode, PipelineCallback callback);
+
+    Stats get_stats();
+
+private:
+    // Descriptor content as bytes. Fields are appended one by one, struct padding stays out.
+    class Key {
+    public:
+        template <typename T>
+        void add(T const& value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            this->bytes.append(reinterpret_cast<char const*>(&value), sizeof(T));
+        }
+
+        // null and empty strings differ
+        void add_string(char const* text);
+
+        template <typename T>
+        void add_object(T const& object) {
+            add(static_cast<void const*>(object.Get()));
+        }
+
+        std::string bytes;
+    };
+
+    struct PipelineEntry {
+        wgpu::RenderPipeline pipeline;
+        wgpu::Future future;
+        bool pending = true;
+        std::vector<PipelineCallback> callbacks;
+    };
+
+    static void add_constants(Key& key, size_t count, wgpu::ConstantEntry const* constants);
+
+    static Key render_pipeline_key(wgpu::RenderPipelineDescriptor const& descriptor);
+
+    // Whether the modules of descriptor were created by get_shader_module(). Requires mutex.
+    bool has_registered_modules(wgpu::RenderPipelineDescriptor const& descriptor) const;
+
+    // CreateRenderPipelineAsync with the error reporting of the registry, nothing is kept.
+    wgpu::Future create_render_pipeline(wgpu::RenderPipelineDescriptor const& descriptor,
+                                        wgpu::CallbackMode mode, PipelineCallback callback);
+
+    wgpu::Device device;
+    // picks the embedded form of shaders, resolved once
+    wgpu::BackendType backend;
+    std::mutex mutex;
+    std::unordered_map<std::string, wgpu::ShaderModule> shader_modules;
+    std::unordered_set<void const*> registered_modules;
+    std::unordered_map<std::string, wgpu::Sampler> samplers;
+    std::unordered_map<std::string, wgpu::BindGroupLayout> bind_group_layouts;
+    std::unordered_map<std::string, wgpu::PipelineLayout> pipeline_layouts;
+    std::unordered_map<std::string, PipelineEntry> render_pipelines;
+    uint32_t hits = 0;
+};
@@ -0,0 +1,703 @@
+#include "render_service.h"
+
+#include <imgui/imgui.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#include "blob_cache.h"
+#include "shaders.h"
+
+using namespace wgpu;
+
+// See PipelineFactory.
+static Future create_fullscreen_pipeline(ObjectRegistry& registry, ShaderModule shader_module,
+                                         PipelineLayout layout, char const * label,
+                                         CallbackMode mode, PipelineCallback callback) {
+    ColorTargetState color_target_state{
+        .format = TextureFormat::BGRA8Unorm
+    };
+
+    FragmentState fragment_state{
+        .module = shader_module,
+        .targetCount = 1,
+        .targets = &color_target_state
+    };
+
+    RenderPipelineDescriptor descriptor{
+        .label = label,
+        .layout = layout,
+        .vertex = { .module = shader_module },
+        .fragment = &fragment_state
+    };
+    return registry.get_render_pipeline(descriptor, mode, std::move(callback));
+}
+
+// Screen capture as binary PPM.
+static void write_capture(char const * file_name, char const * image_data, ImageDataLayout const& layout) {
+    std::ofstream file(file_name);
+    file << "P6\n" << layout.width << " " << layout.height << "\n" << 255 << "\n";
+    for (int row = 0; row <layout.height; row++) {
+        char const * pixel = image_data + row * layout.row_stride;
+        for (int col = 0; col <layout.width; col++, pixel += 4) {
+            if (layout.format == TextureFormat::BGRA8Unorm) {
+                char rgb[3] = { *(pixel + 2), *(pixel + 1), *pixel };
+                file.write(rgb, 3);
+            } else {
+                file.write(pixel, 3);
+            }
+        }
+    }
+}
+
+RenderService& RenderService::instance() {
+    static RenderService service;
+    return service;
+}
+
+RenderService::~RenderService() {
+    stop();
+}
+
+void RenderService::start() {
+    assert(!this->thread.joinable());
+    this->keep_rendering = true;
+    this->thread = std::thread(&RenderService::run, this);
+}
+
+void RenderService::stop() {
+    this->keep_rendering = false;
+    this->scheduler.stop();
+    if (this->thread.joinable()) {
+        this->thread.join();
+    }
+}
+
+ViewId RenderService::add_view(ViewCallback callback, StatusCallback status_callback) {
+    ViewId id;
+    {
+        std::lock_guard<std::mutex> lock(this->views_mutex);
+        id = this->next_view_id++;
+        View& view = this->views[id];
+        view.id = id;
+        view.callback = std::move(callback);
+        view.status_callback = std::move(status_callback);
+        // a consumer holds one frame and has one pending
+        view.releases.reserve(SharedTargets::target_count);
+        view.frame_releases.reserve(SharedTargets::target_count);
+    }
+    this->scheduler.wake();
+    return id;
+}
+
+void RenderService::remove_view(ViewId id) {
+    // waits for a callback in progress
+    std::lock_guard<std::mutex> callback_lock(this->callback_mutex);
+    std::lock_guard<std::mutex> lock(this->views_mutex);
+    auto found = this->views.find(id);
+    if (found == this->views.end() || found->second.removed) {
+        return;
+    }
+    if (this->status == RenderStatus::Failed) {
+        // nothing was rendered, the render thread doesn't touch the views
+        this->views.erase(found);
+        return;
+    }
+    // The render thread destroys the view and its targets; frames the consumer still holds stay
+    // valid through its own imports.
+    View& view = found->second;
+    view.removed = true;
+    view.callback = nullptr;
+    view.status_callback = nullptr;
+}
+
+void RenderService::update_view(ViewId id, uint32_t width, uint32_t height, float t) {
+    {
+        std::lock_guard<std::mutex> lock(this->views_mutex);
+        auto found = this->views.find(id);
+        if (found == this->views.end()) {
+            return;
+        }
+        View& view = found->second;
+        if (view.width == width && view.height == height && view.t == t) {
+            return;
+        }
+        view.width = width;
+        view.height = height;
+        view.t = t;
+        view.dirty = true;
+    }
+    this->scheduler.wake();
+}
+
+void RenderService::overlay_mouse_pos(ViewId id, float x, float y) {
+    if (id != this->overlay_view) {
+        return;
+    }
+    this->imgui_input.add_mouse_pos(x, y);
+    this->scheduler.wake();
+}
+
+void RenderService::overlay_mouse_button(ViewId id, int button, bool down) {
+    if (id != this->overlay_view) {
+        return;
+    }
+    this->imgui_input.add_mouse_button(button, down);
+    this->scheduler.wake();
+}
+
+void RenderService::overlay_mouse_wheel(ViewId id, float x, float y) {
+    if (id != this->overlay_view) {
+        return;
+    }
+    this->imgui_input.add_mouse_wheel(x, y);
+    this->scheduler.wake();
+}
+
+void RenderService::release_frame(ViewId id, uint32_t buffer_id, int fence_fd) {
+    {
+        std::lock_guard<std::mutex> lock(this->views_mutex);
+        auto found = this->views.find(id);
+        if (found != this->views.end() && !found->second.removed) {
+            found->second.releases.push_back({buffer_id, fence_fd});
+            fence_fd = -1;
+        }
+    }
+    if (fence_fd >= 0) {
+        close_fence(fence_fd);
+        return;
+    }
+    // a view may be waiting for a free target
+    this->scheduler.wake();
+}
+
+void RenderService::set_status(RenderStatus status) {
+    if (this->status == status) {
+        return;
+    }
+    this->status = status;
+    for (auto& [id, view] : this->views) {
+        if (view.status_callback) {
+            view.status_callback(status);
+        }
+    }
+}
+
+void RenderService::drop_removed_views() {
+    this->removed_views.clear();
+    {
+        std::lock_guard<std::mutex> lock(this->views_mutex);
+        for (auto it = this->views.begin(); it != this->views.end(); it++) {
+            if (it->second.removed) {
+                this->removed_views.push_back(it);
+            }
+        }
+    }
+    if (this->removed_views.empty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(this->views_mutex);
+    for (Views::iterator it : this->removed_views) {
+        View& view = it->second;
+        for (std::vector<Release>* releases : {&view.releases, &view.frame_releases}) {
+            for (Release release : *releases) {
+                close_fence(release.fence_fd);
+            }
+        }
+        this->views.erase(it);
+    }
+    this->removed_views.clear();
+    this->allocation_check.restart();
+}
+
+void RenderService::run() {
+    init();
+    if (!this->gpu.device) {
+        return;
+    }
+    while (this->keep_rendering) {
+        if (render_frame()) {
+            this->settle_frames = 3;
+        } else if (this->settle_frames > 0) {
+            this->settle_frames--;
+        }
+        this->scheduler.wait_for_next_frame(this->settle_frames == 0);
+    }
+    release();
+}
+
+void RenderService::init() {
+    this->init_start = std::chrono::steady_clock::now();
+    this->gpu = init_webgpu(!this->shader_directory.empty());
+    if (!this->gpu.device) {
+        std::lock_guard<std::mutex> lock(this->views_mutex);
+        set_status(RenderStatus::Failed);
+        return;
+    }
+
+    this->shared_device = std::make_unique<SharedTextureDevice>(this->gpu.device);
+    if (!this->shared_device->is_supported()) {
+        // there is no other way to the consumer
+        this->shared_device.reset();
+        this->gpu = GPU{};
+        std::lock_guard<std::mutex> lock(this->views_mutex);
+        set_status(RenderStatus::Failed);
+        return;
+    }
+
+    this->registry = std::make_unique<ObjectRegistry>(this->gpu.device);
+
+    // Explicit layout, bind groups stay valid when the pipeline is replaced by reloaded shaders.
+    // params of each view at its dynamic offset in the frame uniforms
+    BindGroupLayoutEntry params_layout_entry{
+        .binding = 0,
+        .visibility = ShaderStage::Vertex | ShaderStage::Fragment,
+        .buffer = {.type = BufferBindingType::Uniform, .hasDynamicOffset = true, .minBindingSize = 16},
+    };
+    BindGroupLayoutDescriptor params_layout_desc{
+        .label = "canvas params",
+        .entryCount = 1,
+        .entries = &params_layout_entry,
+    };
+    this->canvas_params_layout = this->registry->get_bind_group_layout(params_layout_desc);
+    PipelineLayoutDescriptor canvas_layout_desc{
+        .label = "canvas",
+        .bindGroupLayoutCount = 1,
+        .bindGroupLayouts = &this->canvas_params_layout,
+    };
+    this->canvas_pipeline_layout = this->registry->get_pipeline_layout(canvas_layout_desc);
+
+    // compiles while the rest is set up, frames are skipped until it is ready
+    this->canvas_pipeline_future = create_fullscreen_pipeline(
+        *this->registry, this->registry->get_shader_module(canvas_shader),
+        this->canvas_pipeline_layout, "canvas", CallbackMode::AllowProcessEvents,
+        [this](RenderPipeline pipeline) {
+            // unless a shader reload landed first
+            if (!this->canvas_pipeline) {
+                this->canvas_pipeline = pipeline;
+            }
+        });
+
+    this->pool = std::make_unique<ResourcePool>(this->gpu.device);
+    this->uniforms = std::make_unique<FrameUniforms>(*this->pool);
+    this->frame_tracker = std::make_unique<FrameTracker>(this->gpu, this->frames_in_flight);
+    this->gpu_timer = std::make_unique<GpuTimer>(this->gpu);
+    this->belt = std::make_unique<StagingBelt>(this->gpu.device);
+    if (this->dynamic_resolution_enabled && !this->gpu_timer->is_supported()) {
+        std::cout << "Dynamic resolution disabled: timestamp queries are not supported\n";
+    }
+
+    if (this->overlay_enabled) {
+        this->imgui = std::make_unique<ImGuiWebGPU>(
+            this->gpu.device, *this->belt, *this->registry, *this->pool, *this->uniforms,
+            this->ui_font_path.empty() ? nullptr : this->ui_font_path.c_str(),
+            this->ui_font_size, this->compact_ui_vertices);
+        this->capture = std::make_unique<TextureCapture>(this->gpu.device, *this->pool);
+        for (uint32_t slot = 0; slot < FrameTracker::max_frames_in_flight; slot++) {
+            this->capture_callbacks[slot] = [this, slot](char const * data, ImageDataLayout const& layout) {
+                write_capture(this->capture_file_names[slot], data, layout);
+            };
+        }
+    }
+
+    if (!this->shader_directory.empty()) {
+        watch_shaders();
+    }
+}
+
+void RenderService::watch_shaders() {
+    if (!this->gpu.device.HasFeature(FeatureName::ImplicitDeviceSynchronization)) {
+        std::cout << "Shader hot reload disabled: the device is single threaded\n";
+        return;
+    }
+    this->shader_watcher = std::make_unique<ShaderWatcher>(
+        this->gpu.device, this->shader_directory, [this] { this->scheduler.wake(); });
+    this->shader_watcher->watch(
+        "canvas",
+        [this](ShaderModule module, CallbackMode mode, PipelineCallback callback) {
+            return create_fullscreen_pipeline(*this->registry, module,
+                                              this->canvas_pipeline_layout, "canvas", mode,
+                                              std::move(callback));
+        },
+        &this->canvas_pipeline);
+    if (this->imgui) {
+        this->imgui->watch_shader(*this->shader_watcher);
+    }
+    this->shader_watcher->start();
+}
+
+bool RenderService::wait_until_ready() {
+    FutureWaitInfo created{.future = this->canvas_pipeline_future};
+    this->gpu.instance.WaitAny(1, &created, UINT64_MAX);
+    bool ready = bool(this->canvas_pipeline);
+    if (this->imgui) {
+        ready = this->imgui->wait_until_ready() && ready;
+    }
+    return ready;
+}
+
+void RenderService::release() {
+    this->shader_watcher.reset();
+    // the pipeline callbacks reference this
+    wait_until_ready();
+    drop_removed_views();
+    {
+        std::lock_guard<std::mutex> lock(this->views_mutex);
+        this->frame_views.clear();
+        for (auto& [id, view] : this->views) {
+            this->frame_views.push_back(&view);
+        }
+    }
+    // only the render thread touches the targets
+    for (View* view : this->frame_views) {
+        view->targets.reset();
+        view->target = nullptr;
+    }
+    this->frame_views.clear();
+    this->canvas_params = nullptr;
+    this->canvas_params_buffer = nullptr;
+    this->frame_tracker.reset();
+    this->gpu_timer.reset();
+    this->capture.reset();
+    this->imgui.reset();
+    this->belt.reset();
+    this->uniforms.reset();
+    this->pool.reset();
+    this->canvas_pipeline = nullptr;
+    this->canvas_pipeline_layout = nullptr;
+    this->canvas_params_layout = nullptr;
+    this->registry.reset();
+    this->shared_device.reset();
+    this->gpu.release();
+}
+
+bool RenderService::render_frame() {
+    // reloaded shaders take effect between frames
+    bool reloaded = this->shader_watcher && this->shader_watcher->apply();
+    if (reloaded) {
+        this->allocation_check.restart();
+    }
+
+    if (!this->canvas_pipeline) {
+        // every view needs it, keep polling until it is compiled
+        FutureWaitInfo created{.future = this->canvas_pipeline_future};
+        this->gpu.instance.WaitAny(1, &created, 0);
+        if (created.completed) {
+            std::lock_guard<std::mutex> lock(this->views_mutex);
+            set_status(this->canvas_pipeline ? RenderStatus::Ready : RenderStatus::Failed);
+        }
+        if (!this->canvas_pipeline) {
+            return this->status != RenderStatus::Failed;
+        }
+    }
+
+    this->allocation_check.begin_frame();
+    ResourcePool::Stats const& pool_stats = this->pool->get_stats();
+    uint32_t created = pool_stats.buffers_created + pool_stats.textures_created;
+    // waits for the slot without blocking update_view()
+    uint32_t slot = this->frame_tracker->begin_frame();
+    drop_removed_views();
+
+    // The views' parameters are copied under a short lock; the rest of the frame only uses the
+    // render thread's fields of the views.
+    bool changed = reloaded;
+    {
+        std::lock_guard<std::mutex> lock(this->views_mutex);
+        this->frame_views.clear();
+        for (auto& [id, view] : this->views) {
+            if (view.removed) {
+                continue;
+            }
+            view.frame_width = view.width;
+            view.frame_height = view.height;
+            view.frame_t = view.t;
+            changed |= view.dirty;
+            view.dirty = false;
+            std::swap(view.releases, view.frame_releases);
+            this->frame_views.push_back(&view);
+        }
+    }
+    for (View* view : this->frame_views) {
+        if (!view->targets) {
+            view->targets = std::make_unique<SharedTargets>(*this->shared_device);
+            this->allocation_check.restart();
+        }
+        for (Release release : view->frame_releases) {
+            view->targets->release(release.buffer_id, release.fence_fd);
+        }
+        view->frame_releases.clear();
+    }
+
+    // a params block per view and the overlay's view info
+    this->uniforms->begin_frame((this->frame_views.size() + 1) * FrameUniforms::alignment);
+    if (this->canvas_params_buffer.Get() != this->uniforms->get_buffer().Get()) {
+        this->canvas_params_buffer = this->uniforms->get_buffer();
+        BindGroupEntry params_entry{.binding = 0, .buffer = this->canvas_params_buffer, .size = 16};
+        BindGroupDescriptor bind_group_desc{
+            .layout = this->canvas_params_layout,
+            .entryCount = 1,
+            .entries = &params_entry,
+        };
+        this->canvas_params = this->gpu.device.CreateBindGroup(&bind_group_desc);
+        this->allocation_check.restart();
+    }
+
+    CommandEncoder encoder;
+    {
+        WebGPUAllocations webgpu;
+        encoder = this->gpu.device.CreateCommandEncoder();
+    }
+    this->gpu_timer->begin(slot, encoder);
+    View* primary_view = nullptr;
+
+    for (View* frame_view : this->frame_views) {
+        View& view = *frame_view;
+        view.render_width = 0;
+        view.render_height = 0;
+        view.target = nullptr;
+        if (view.frame_width == 0 || view.frame_height == 0) {
+            continue;
+        }
+
+        uint32_t width = this->resolution.scaled(view.frame_width);
+        uint32_t height = this->resolution.scaled(view.frame_height);
+        // skipped while the consumer holds all targets, release_frame() wakes the next frame
+        view.target = view.targets->acquire(width, height);
+        if (!view.target) {
+            continue;
+        }
+        if (!view.target->initialized) {
+            // just created
+            this->allocation_check.restart();
+        }
+        view.targets->begin_access(*view.target);
+        view.render_width = width;
+        view.render_height = height;
+
+        float params[4] = {float(width), float(height), view.frame_t, this->resolution.get_scale()};
+        uint32_t params_offset = this->uniforms->allocate(params);
+
+        RenderPassColorAttachment attachment{
+            .view = view.target->view,
+            .loadOp = LoadOp::Clear,
+            .storeOp = StoreOp::Store
+        };
+
+        RenderPassDescriptor render_pass{
+            .colorAttachmentCount = 1,
+            .colorAttachments = &attachment
+        };
+
+        {
+            WebGPUAllocations webgpu;
+            // the shared target may be larger than the render size
+            RenderPassEncoder pass = encoder.BeginRenderPass(&render_pass);
+            pass.SetViewport(0.0f, 0.0f, float(width), float(height), 0.0f, 1.0f);
+            pass.SetScissorRect(0, 0, width, height);
+            pass.SetPipeline(this->canvas_pipeline);
+            pass.SetBindGroup(0, this->canvas_params, 1, &params_offset);
+            pass.Draw(3);
+            pass.End();
+        }
+
+        if (!primary_view) {
+            primary_view = &view;
+        }
+    }
+
+    // The debug overlay is drawn on top of the first view.
+    bool captured = false;
+    // the overlay shows up once its pipeline is ready, without holding back the views
+    this->overlay_view = primary_view ? primary_view->id : 0;
+    if (this->overlay_enabled && primary_view && this->imgui->is_ready()) {
+        this->imgui_input.feed(float(primary_view->render_width),
+                               float(primary_view->render_height));
+        changed |= !this->imgui_input.is_idle();
+        captured = render_overlay(slot, *primary_view, encoder);
+        changed |= this->imgui->glyphs_changed();
+        if (this->imgui->glyphs_changed()) {
+            this->allocation_check.restart();
+        }
+    }
+
+    this->gpu_timer->end(slot, encoder);
+
+    // the whole frame is a single submission, its uploads go first
+    this->uniforms->end_frame(*this->belt);
+    CommandBuffer upload = this->belt->finish();
+    {
+        WebGPUAllocations webgpu;
+        CommandBuffer commands[2] = {upload, encoder.Finish()};
+        this->gpu.device.GetQueue().Submit(2, commands);
+    }
+    this->belt->recall();
+    this->pool->submitted();
+
+    // The frames go to the consumer right away, their fences signal when the GPU finished them.
+    for (View* view : this->frame_views) {
+        if (!view->target) {
+            continue;
+        }
+        SharedFrame frame =
+            view->targets->end_access(*view->target, view->render_width, view->render_height);
+        std::unique_lock<std::mutex> lock(this->callback_mutex);
+        if (view->callback) {
+            // the consumer's allocations aren't the frame's
+            UncountedAllocations uncounted;
+            view->callback(frame);
+        } else {
+            // removed, or a consumer that only measures
+            lock.unlock();
+            view->targets->release(frame.buffer.id, frame.fence_fd);
+        }
+    }
+
+    if (!this->first_frame_reported && primary_view) {
+        // warm starts load shaders and pipelines from the blob cache
+        this->first_frame_reported = true;
+        auto init_start = this->init_start;
+        this->gpu.device.GetQueue().OnSubmittedWorkDone(
+            CallbackMode::AllowProcessEvents, [init_start](QueueWorkDoneStatus status) {
+                std::chrono::duration<double, std::milli> elapsed =
+                    std::chrono::steady_clock::now() - init_start;
+                BlobCache::Stats stats = BlobCachePlatform::instance().get_cache().get_stats();
+                std::cout << "Time to first frame: " << elapsed.count() << " ms, "
+                          << (stats.hits > 0 ? "warm" : "cold") << " start (blob cache: "
+                          << stats.hits << " hits, " << stats.misses << " misses, "
+                          << stats.total_bytes / 1024 << " KiB)\n";
+            });
+    }
+
+    this->frame_tracker->end_frame();
+    this->gpu_timer->map(slot);
+
+    if (captured) {
+        this->capture->pop(slot);
+        // a capture sequence records at the target rate, without counting as a content change
+        this->scheduler.wake();
+    }
+
+    // Poll for and process events
+    {
+        WebGPUAllocations webgpu;
+        this->gpu.instance.ProcessEvents();
+    }
+
+    if (this->dynamic_resolution_enabled) {
+        float scale = this->resolution.get_scale();
+        // resizing the views changes their content
+        changed |= this->resolution.update(this->gpu_timer->get_last_frame_ms()) != scale;
+    }
+
+    // new pooled resources mean a new working set
+    if (pool_stats.buffers_created + pool_stats.textures_created != created) {
+        this->allocation_check.restart();
+    }
+    this->allocation_check.end_frame();
+    return changed;
+}
+
+bool RenderService::render_overlay(uint32_t slot, View& view, CommandEncoder encoder) {
+    Extent3D size{view.render_width, view.render_height};
+    this->imgui->begin_frame(slot, size.width, size.height);
+
+    // simple fps counter
+    static int frame_count = 0;
+    static auto prev = std::chrono::high_resolution_clock::now();
+    static float mean_fps = 0.0;
+    if (frame_count >= 60) {
+        auto now = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::micro> mean_us = now - prev;
+        mean_fps = float(frame_count) / (mean_us.count() * 1e-6);
+        prev = now;
+        frame_count = 1;
+    } else {
+        frame_count++;
+    }
+
+    ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav;
+    window_flags |= ImGuiWindowFlags_NoMove;
+
+    const float PAD = 10.0f;
+    const ImGuiViewport* viewport = ImGui::GetMainViewport();
+    ImVec2 work_pos = viewport->WorkPos; // Use work area to avoid menu-bar/task-bar, if any!
+    ImVec2 work_size = viewport->WorkSize;
+    ImVec2 window_pos, window_pos_pivot;
+    window_pos.x = work_pos.x + PAD;
+    window_pos.y = work_pos.y + PAD;
+    window_pos_pivot.x = 0.0f;
+    window_pos_pivot.y = 0.0f;
+    ImGui::SetNextWindowPos(window_pos, ImGuiCond_Always, window_pos_pivot);
+
+    static int capture_seq = 0;
+    static int capture_frame = 0;
+    // opt-in, every captured frame is written to disk
+    static bool do_capture = false;
+    static bool capture_include_ui = false;
+    if (ImGui::Begin("Example: Simple overlay", nullptr, window_flags)) {
+        ImGui::Text("[F1] Open/Close demo window");
+        ImGui::Text("Fps: %.1f", mean_fps);
+        StagingBelt::Stats const& belt_stats = this->belt->get_stats();
+        ImGui::Text("Staging: %.0f KiB, recycled in %.2f ms (max %.2f ms)",
+                    belt_stats.peak_bytes / 1024.0, belt_stats.last_recycle_ms,
+                    belt_stats.max_recycle_ms);
+        ResourcePool::Stats const& pool_stats = this->pool->get_stats();
+        ImGui::Text("Pool: %u buffers, %u textures created, %u reused, %.0f KiB free",
+                    pool_stats.buffers_created, pool_stats.textures_created, pool_stats.reused,
+                    pool_stats.free_buffer_bytes / 1024.0);
+        ObjectRegistry::Stats objects = this->registry->get_stats();
+        ImGui::Text("Objects: %u pipelines, %u layouts, %u bind group layouts, %u samplers, %u hits",
+                    objects.render_pipelines, objects.pipeline_layouts, objects.bind_group_layouts,
+                    objects.samplers, objects.hits);
+        const char * capture_btn_labels[2] = { "Screen capture", "Stop capture" };
+        const ImVec4 capture_btn_colors[2] = { ImGui::GetStyleColorVec4(ImGuiCol_Button), (ImVec4)ImColor::HSV(0.0f, 0.6f, 0.6f) };
+        const ImVec4 capture_btn_hovered_colors[2] = { ImGui::GetStyleColorVec4(ImGuiCol_ButtonHovered), (ImVec4)ImColor::HSV(0.0f, 0.6f, 0.8f) };
+        const ImVec4 capture_btn_active_colors[2] = { ImGui::GetStyleColorVec4(ImGuiCol_ButtonActive), (ImVec4)ImColor::HSV(0.0f, 0.6f, 1.0f) };
+        ImGui::PushStyleColor(ImGuiCol_Button, capture_btn_colors[do_capture]);
+        ImGui::PushStyleColor(ImGuiCol_ButtonHovered, capture_btn_hovered_colors[do_capture]);
+        ImGui::PushStyleColor(ImGuiCol_ButtonActive, capture_btn_active_colors[do_capture]);
+        if (ImGui::Button(capture_btn_labels[do_capture])) {
+            do_capture = !do_capture;
+            if (do_capture) {
+                capture_seq = (capture_seq + 1) % 100;
+                capture_frame = 0;
+            }
+        }
+        ImGui::PopStyleColor(3);
+        ImGui::SameLine();
+        ImGui::Checkbox("/w UI", &capture_include_ui);
+
+        if (do_capture) {
+            // the slot's name is read when its capture is written
+            std::snprintf(this->capture_file_names[slot], sizeof(this->capture_file_names[slot]),
+                          "capture_s%02d_%05d.ppm", capture_seq, capture_frame);
+            ImGui::Text("%s", this->capture_file_names[slot]);
+            capture_frame = (capture_frame + 1) % 10000;
+        }
+    }
+    ImGui::End();
+
+    // UI pass and capture copy share the frame's encoder and execute in recording order, so the
+    // capture contains the UI only when the UI pass is recorded first.
+    if (capture_include_ui) {
+        this->imgui->end_frame(view.target->texture, encoder);
+    }
+
+    if (do_capture) {
+        this->capture->push(slot, view.target->texture, size, encoder, this->capture_callbacks[slot]);
+    }
+
+    if (!capture_include_ui) {
+        this->imgui->end_frame(view.target->texture, encoder);
+    }
+
+    return do_capture;
+}
+
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "allocation_counter.h"
+#include "dynamic_resolution.h"
+#include "frame_scheduler.h"
+#include "frame_uniforms.h"
+#include "imgui_helpers.h"
+#include "object_registry.h"
+#include "resource_pool.h"
+#include "shader_watcher.h"
+#include "shared_texture.h"
+#include "staging_belt.h"
+#include "webgpu_helpers.h"
+
+using ViewId = uint32_t;
+// Called on the render thread with every frame of the view. Each frame has to be handed back with
+// release_frame() once the consumer stopped showing it, or the view runs out of targets.
+using ViewCallback = std::function<void(SharedFrame const& frame)>;
+
+enum class RenderStatus {
+    // device and pipelines are being created on the render thread
+    Initializing,
+    // views are rendered
+    Ready,
+    // no device, no canvas pipeline or no dma-buf sharing, views stay empty
+    Failed,
+};
+using StatusCallback = std::function<void(RenderStatus)>;
+
+// Owns the single WebGPU device of the process. Every registered view gets its own ring of shared
+// render targets whose content is generated on the GPU from the view parameters; all views are
+// encoded into one command buffer and submitted once per frame. Finished frames are handed to the
+// view callback as dma-bufs with a fence, the consumer samples them on its GPU without a copy.
+class RenderService {
+public:
+    static RenderService& instance();
+
+    ~RenderService();
+
+    // Spawns the render thread, which initializes the device and renders until stop(). Frames are
+    // paced by the scheduler and drop to its idle rate while neither views nor UI change.
+    void start();
+
+    void stop();
+
+    // Thread safe. The callbacks are never invoked once remove_view() returned, which must not be
+    // called from them. status_callback is called on the render thread when get_status() changes.
+    // Without a callback frames are released right away (benchmarks).
+    ViewId add_view(ViewCallback callback, StatusCallback status_callback = {});
+
+    void remove_view(ViewId id);
+
+    // width, height: pixel size of the consumer. Views render at that size times the dynamic
+    // resolution scale and are upscaled by the consumer.
+    void update_view(ViewId id, uint32_t width, uint32_t height, float t);
+
+    // Thread safe. Hands back the frame of the view with buffer_id, fence_fd (owned, -1 for none)
+    // signals when the consumer stopped sampling it.
+    void release_frame(ViewId id, uint32_t buffer_id, int fence_fd);
+
+    // Scales the render size of all views so that their measured GPU time stays within budget_ms.
+    // Requires timestamp query support. Takes effect at init().
+    void set_dynamic_resolution(bool enabled, double budget_ms) {
+        this->dynamic_resolution_enabled = enabled;
+        this->resolution.set_budget_ms(budget_ms);
+    }
+
+    // The debug overlay (fps counter, screen capture) is drawn on top of the first view.
+    void set_overlay_enabled(bool enabled) {
+        this->overlay_enabled = enabled;
+    }
+
+    // Thread safe. Mouse input over a view for the overlay, positions normalized to the view's
+    // size; ignored unless the view shows the overlay. Wakes the render thread.
+    void overlay_mouse_pos(ViewId id, float x, float y);
+
+    void overlay_mouse_button(ViewId id, int button, bool down);
+
+    void overlay_mouse_wheel(ViewId id, float x, float y);
+
+    // TrueType font of the overlay, see ImGuiWebGPU. Takes effect at init().
+    void set_ui_font(std::string path, float size_px) {
+        this->ui_font_path = std::move(path);
+        this->ui_font_size = size_px;
+    }
+
+    // Overlay vertices as CompactDrawVert. Takes effect at init().
+    void set_compact_ui_vertices(bool enabled) {
+        this->compact_ui_vertices = enabled;
+    }
+
+    // Reloads shaders from directory when their files change, see ShaderWatcher. Takes effect at
+    // init().
+    void set_shader_directory(std::string directory) {
+        this->shader_directory = std::move(directory);
+    }
+
+    // Number of frames the CPU may queue ahead of the GPU, 1 to 3. Takes effect at init().
+    void set_frames_in_flight(uint32_t count) {
+        assert(count >= 1 && count <= FrameTracker::max_frames_in_flight);
+        this->frames_in_flight = count;
+    }
+
+    // Render thread only, also driven directly by the benchmark.
+    void init();
+
+    // Returns false when nothing changed since the previous frame. Views are rendered once the
+    // canvas pipeline is compiled, the overlay once its own pipeline is.
+    bool render_frame();
+
+    // Blocks until the pipelines created by init() are compiled. False when one of them failed.
+    bool wait_until_ready();
+
+    void release();
+
+    // Thread safe.
+    RenderStatus get_status() const {
+        return this->status;
+    }
+
+    FrameScheduler& get_scheduler() {
+        return this->scheduler;
+    }
+
+    GPU const& get_gpu() const {
+        return this->gpu;
+    }
+
+private:
+    struct Release {
+        uint32_t buffer_id;
+        int fence_fd;
+    };
+
+    // The first fields are guarded by views_mutex, the rest belongs to the render thread.
+    struct View {
+        ViewId id = 0;
+        // guarded by callback_mutex as well
+        ViewCallback callback;
+        StatusCallback status_callback;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        float t = 0.0f;
+        bool dirty = true;
+        // set by remove_view(), dropped by the render thread
+        bool removed = false;
+        // from release_frame(), swapped with frame_releases at the start of the frame
+        std::vector<Release> releases;
+
+        std::vector<Release> frame_releases;
+        // parameters copied at the start of the frame
+        uint32_t frame_width = 0;
+        uint32_t frame_height = 0;
+        float frame_t = 0.0f;
+        // size rendered this frame, 0 when the view was skipped
+        uint32_t render_width = 0;
+        uint32_t render_height = 0;
+        std::unique_ptr<SharedTargets> targets;
+        // rendered this frame, null when the view was skipped
+        SharedTargets::Target* target = nullptr;
+    };
+
+    void run();
+
+    void watch_shaders();
+
+    // views_mutex held
+    void set_status(RenderStatus status);
+
+    // Render thread. Destroys the views removed since the last frame.
+    void drop_removed_views();
+
+    // Records the overlay into the frame's encoder. Returns true when a screen capture was queued.
+    bool render_overlay(uint32_t slot, View& view, wgpu::CommandEncoder encoder);
+
+    GPU gpu;
+    std::unique_ptr<ObjectRegistry> registry;
+    // transient buffers and textures, recycled after the frames using them retire
+    std::unique_ptr<ResourcePool> pool;
+    std::unique_ptr<FrameUniforms> uniforms;
+    // the canvas params of all views, at their dynamic offsets; made on the uniforms buffer
+    wgpu::BindGroup canvas_params;
+    wgpu::Buffer canvas_params_buffer;
+    wgpu::BindGroupLayout canvas_params_layout;
+    wgpu::PipelineLayout canvas_pipeline_layout;
+    wgpu::RenderPipeline canvas_pipeline;
+    wgpu::Future canvas_pipeline_future;
+    std::unique_ptr<SharedTextureDevice> shared_device;
+    std::unique_ptr<FrameTracker> frame_tracker;
+    uint32_t frames_in_flight = 2;
+    std::unique_ptr<GpuTimer> gpu_timer;
+    // uploads of the frame, submitted ahead of its command buffer
+    std::unique_ptr<StagingBelt> belt;
+    DynamicResolution resolution;
+    bool dynamic_resolution_enabled = false;
+
+    using Views = std::map<ViewId, View>;
+
+    // Held briefly by the render thread, never across fence waits, encoding or submission.
+    std::mutex views_mutex;
+    // held while a view callback runs, so that remove_view() can wait for it
+    std::mutex callback_mutex;
+    // nodes are only erased by the render thread
+    Views views;
+    ViewId next_view_id = 1;
+    // render thread: the views of the current frame and the removed ones being dropped
+    std::vector<View*> frame_views;
+    std::vector<Views::iterator> removed_views;
+
+    bool overlay_enabled = true;
+    std::unique_ptr<ImGuiWebGPU> imgui;
+    std::string ui_font_path;
+    float ui_font_size = 13.0f;
+    bool compact_ui_vertices = false;
+    ImGuiInput imgui_input;
+    // the view the overlay is drawn on, 0 for none; set by the render thread
+    std::atomic<ViewId> overlay_view = 0;
+    std::unique_ptr<TextureCapture> capture;
+    // per frame slot, kept until the slot's capture is written: capturing doesn't allocate
+    char capture_file_names[FrameTracker::max_frames_in_flight][32] = {};
+    TextureCapture::Callback capture_callbacks[FrameTracker::max_frames_in_flight];
+    std::string shader_directory;
+    std::unique_ptr<ShaderWatcher> shader_watcher;
+
+    // startup time until the first view is rendered, reported once
+    std::chrono::steady_clock::time_point init_start;
+    bool first_frame_reported = false;
+
+    // test builds abort when a frame after warm-up allocates, see allocation_counter.h
+    FrameAllocationCheck allocation_check;
+
+    FrameScheduler scheduler;
+    // Frames kept at the target rate after the last change, so that pending captures drain.
+    uint32_t settle_frames = 0;
+
+    std::thread thread;
+    std::atomic<bool> keep_rendering = false;
+    std::atomic<RenderStatus> status = RenderStatus::Initializing;
+};
@@ -0,0 +1,153 @@
+#include "resource_pool.h"
+
+#include <algorithm>
+#include <type_traits>
+
+#include "allocation_counter.h"
+
+using namespace wgpu;
+
+ResourcePool::ResourcePool(Device device)
+: device(device), instance(device.GetAdapter().GetInstance()) {}
+
+uint64_t ResourcePool::size_class(uint64_t size) {
+    uint64_t size_class = 256;
+    while (size_class < size) {
+        size_class *= 2;
+    }
+    return size_class;
+}
+
+ResourcePool::BufferKey ResourcePool::buffer_key(Buffer buffer) {
+    return {static_cast<uint32_t>(buffer.GetUsage()), buffer.GetSize()};
+}
+
+ResourcePool::TextureKey ResourcePool::texture_key(TextureDescriptor const& descriptor) {
+    return {static_cast<uint32_t>(descriptor.format), static_cast<uint32_t>(descriptor.usage),
+            static_cast<uint32_t>(descriptor.dimension), descriptor.size.width, descriptor.size.height, descriptor.size.depthOrArrayLayers,
+            descriptor.mipLevelCount, descriptor.sampleCount};
+}
+
+ResourcePool::TextureKey ResourcePool::texture_key(Texture texture) {
+    return {static_cast<uint32_t>(texture.GetFormat()), static_cast<uint32_t>(texture.GetUsage()),
+            static_cast<uint32_t>(texture.GetDimension()), texture.GetWidth(), texture.GetHeight(), texture.GetDepthOrArrayLayers(),
+            texture.GetMipLevelCount(), texture.GetSampleCount()};
+}
+
+Buffer ResourcePool::acquire_buffer(BufferUsage usage, uint64_t size, char const* label) {
+    size = size_class(size);
+    auto found = this->free_buffers.find({static_cast<uint32_t>(usage), size});
+    if (found != this->free_buffers.end() && !found->second.empty()) {
+        Buffer buffer = found->second.back().object;
+        found->second.pop_back();
+        this->stats.free_buffer_bytes -= size;
+        this->stats.reused++;
+        return buffer;
+    }
+
+    BufferDescriptor desc{
+        .label = label,
+        .usage = usage,
+        .size = size,
+    };
+    this->stats.buffers_created++;
+    return this->device.CreateBuffer(&desc);
+}
+
+Texture ResourcePool::acquire_texture(TextureDescriptor const& descriptor) {
+    auto found = this->free_textures.find(texture_key(descriptor));
+    if (found != this->free_textures.end() && !found->second.empty()) {
+        Texture texture = found->second.back().object;
+        found->second.pop_back();
+        this->stats.reused++;
+        return texture;
+    }
+
+    this->stats.textures_created++;
+    return this->device.CreateTexture(&descriptor);
+}
+
+void ResourcePool::release(Buffer buffer) {
+    if (buffer) {
+        this->released_buffers.push_back({this->serial, buffer});
+        this->stats.pending++;
+    }
+}
+
+void ResourcePool::release(Texture texture) {
+    if (texture) {
+        this->released_textures.push_back({this->serial, texture});
+        this->stats.pending++;
+    }
+}
+
+void ResourcePool::submitted() {
+    Future future;
+    {
+        WebGPUAllocations webgpu;
+        // nothing captured, the callback may run after the pool is gone
+        future = this->device.GetQueue().OnSubmittedWorkDone(CallbackMode::WaitAnyOnly,
+                                                             [](QueueWorkDoneStatus) {});
+    }
+    this->fences.push_back({this->serial, future});
+    this->serial++;
+    reclaim();
+}
+
+void ResourcePool::reclaim() {
+    // submissions retire in order
+    while (!this->fences.empty()) {
+        FutureWaitInfo fence{.future = this->fences.front().future};
+        {
+            WebGPUAllocations webgpu;
+            this->instance.WaitAny(1, &fence, 0);
+        }
+        if (!fence.completed) {
+            break;
+        }
+        this->retired_serial = this->fences.front().serial;
+        this->fences.erase(this->fences.begin());
+    }
+
+    // released in serial order
+    auto not_retired = [this](auto const& tagged) { return tagged.serial > this->retired_serial; };
+    auto buffers_end = std::find_if(this->released_buffers.begin(), this->released_buffers.end(),
+                                    not_retired);
+    for (auto it = this->released_buffers.begin(); it != buffers_end; it++) {
+        this->free_buffers[buffer_key(it->object)].push_back({this->retired_serial, it->object});
+        this->stats.free_buffer_bytes += it->object.GetSize();
+        this->stats.pending--;
+    }
+    this->released_buffers.erase(this->released_buffers.begin(), buffers_end);
+    auto textures_end = std::find_if(this->released_textures.begin(),
+                                     this->released_textures.end(), not_retired);
+    for (auto it = this->released_textures.begin(); it != textures_end; it++) {
+        this->free_textures[texture_key(it->object)].push_back({this->retired_serial, it->object});
+        this->stats.pending--;
+    }
+    this->released_textures.erase(this->released_textures.begin(), textures_end);
+
+    trim(this->free_buffers);
+    trim(this->free_textures);
+}
+
+template <typename Key, typename T>
+void ResourcePool::trim(std::map<Key, std::vector<Tagged<T>>>& free) {
+    if (this->retired_serial <= keep_serials) {
+        return;
+    }
+    uint64_t oldest = this->retired_serial - keep_serials;
+    for (auto it = free.begin(); it != free.end();) {
+        std::vector<Tagged<T>>& objects = it->second;
+        // oldest first, acquire() takes from the back
+        auto kept = std::find_if(objects.begin(), objects.end(),
+                                 [oldest](Tagged<T> const& tagged) { return tagged.serial >= oldest; });
+        if constexpr (std::is_same_v<T, Buffer>) {
+            for (auto dropped = objects.begin(); dropped != kept; dropped++) {
+                this->stats.free_buffer_bytes -= dropped->object.GetSize();
+            }
+        }
+        objects.erase(objects.begin(), kept);
+        it = objects.empty() ? free.erase(it) : std::next(it);
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <vector>
+
+// Transient buffers and textures, recycled once the GPU is done with them. A released resource is
+// tagged with the serial of the next submission (see submitted()); when Queue::OnSubmittedWorkDone
+// reports that serial as retired, it goes back to a free list keyed by its size class, where
+// acquire_buffer() and acquire_texture() find it. Steady-state frames then reuse memory instead
+// of allocating. Free resources unused for a while are dropped. Render thread only.
+class ResourcePool {
+public:
+    struct Stats {
+        uint32_t buffers_created = 0;
+        uint32_t textures_created = 0;
+        uint32_t reused = 0;
+        // released, waiting for their submission to retire
+        uint32_t pending = 0;
+        uint64_t free_buffer_bytes = 0;
+    };
+
+    explicit ResourcePool(wgpu::Device device);
+
+    // A buffer of at least size bytes, rounded up to a power of two.
+    wgpu::Buffer acquire_buffer(wgpu::BufferUsage usage, uint64_t size, char const* label = nullptr);
+
+    // A texture matching descriptor exactly, callers round sizes themselves.
+    wgpu::Texture acquire_texture(wgpu::TextureDescriptor const& descriptor);
+
+    // Returns the resource once the work submitted up to the next submitted() has executed. Null
+    // handles are ignored. Mapped buffers must be unmapped first.
+    void release(wgpu::Buffer buffer);
+
+    void release(wgpu::Texture texture);
+
+    // Call after each Queue::Submit: fences the submission and recycles retired resources.
+    void submitted();
+
+    Stats const& get_stats() const {
+        return this->stats;
+    }
+
+    static uint64_t size_class(uint64_t size);
+
+private:
+    using BufferKey = std::pair<uint32_t, uint64_t>;
+    // format, usage, dimension, width, height, layers, mip levels, samples
+    using TextureKey =
+        std::tuple<uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t>;
+
+    template <typename T>
+    struct Tagged {
+        uint64_t serial;
+        T object;
+    };
+
+    struct Fence {
+        uint64_t serial;
+        wgpu::Future future;
+    };
+
+    // Free resources unused for this many submissions are dropped.
+    static constexpr uint64_t keep_serials = 120;
+
+    static BufferKey buffer_key(wgpu::Buffer buffer);
+
+    static TextureKey texture_key(wgpu::TextureDescriptor const& descriptor);
+
+    static TextureKey texture_key(wgpu::Texture texture);
+
+    // Polls the fences without blocking and moves retired resources to the free lists.
+    void reclaim();
+
+    template <typename Key, typename T>
+    void trim(std::map<Key, std::vector<Tagged<T>>>& free);
+
+    wgpu::Device device;
+    wgpu::Instance instance;
+    // serial of the submission being recorded
+    uint64_t serial = 1;
+    uint64_t retired_serial = 0;
+    // Vectors in release order, retired entries are erased from the front in one go: their
+    // capacity settles after warm-up, a deque would allocate a block every few dozen frames.
+    std::vector<Fence> fences;
+    std::vector<Tagged<wgpu::Buffer>> released_buffers;
+    std::vector<Tagged<wgpu::Texture>> released_textures;
+    // tagged with the serial they retired at
+    std::map<BufferKey, std::vector<Tagged<wgpu::Buffer>>> free_buffers;
+    std::map<TextureKey, std::vector<Tagged<wgpu::Texture>>> free_textures;
+    Stats stats;
+};
@@ -0,0 +1,182 @@
+#include "shader_watcher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <system_error>
+
+using namespace wgpu;
+
+namespace fs = std::filesystem;
+
+// Polling keeps the watcher portable; changes show up within this interval.
+static constexpr std::chrono::milliseconds poll_interval{250};
+
+ShaderWatcher::ShaderWatcher(Device device, fs::path directory, std::function<void()> on_reload)
+: device(device), directory(std::move(directory)), on_reload(std::move(on_reload)) {}
+
+ShaderWatcher::~ShaderWatcher() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->stop_requested.notify_all();
+    if (this->thread.joinable()) {
+        this->thread.join();
+    }
+}
+
+void ShaderWatcher::watch(char const* name, PipelineFactory factory, RenderPipeline* pipeline) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    Target target{
+        .factory = std::move(factory),
+        .pipeline = pipeline,
+    };
+    for (std::unique_ptr<Watch>& watch : this->watches) {
+        if (watch->name == name) {
+            watch->targets.push_back(std::move(target));
+            if (watch->reloaded) {
+                // the new pipeline was made from the embedded source
+                watch->modified = {};
+            }
+            return;
+        }
+    }
+
+    auto watch = std::make_unique<Watch>(Watch{
+        .name = name,
+        .path = this->directory / (std::string(name) + ".wgsl"),
+    });
+    watch->targets.push_back(std::move(target));
+    std::error_code error;
+    watch->modified = fs::last_write_time(watch->path, error);
+    if (error) {
+        // kept, so that later targets of the file don't report it again
+        watch->available = false;
+        std::cout << "Not watching " << watch->path.string() << ": " << error.message() << "\n";
+    }
+    this->watches.push_back(std::move(watch));
+}
+
+void ShaderWatcher::start() {
+    std::cout << "Watching shaders in " << this->directory.string() << "\n";
+    this->thread = std::thread(&ShaderWatcher::run, this);
+}
+
+bool ShaderWatcher::apply() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    bool applied = false;
+    for (std::unique_ptr<Watch>& watch : this->watches) {
+        for (Target& target : watch->targets) {
+            if (target.pending) {
+                // frames in flight hold their own reference to the previous pipeline
+                *target.pipeline = target.pending;
+                target.pending = nullptr;
+                applied = true;
+            }
+        }
+    }
+    return applied;
+}
+
+void ShaderWatcher::run() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (!this->stop_requested.wait_for(lock, poll_interval, [this] { return this->stopping; })) {
+        // watch() may append while a file is built, the watches themselves stay put
+        for (size_t i = 0; i < this->watches.size(); i++) {
+            Watch& watch = *this->watches[i];
+            if (!watch.available) {
+                continue;
+            }
+            std::error_code error;
+            fs::file_time_type modified = fs::last_write_time(watch.path, error);
+            if (error || modified == watch.modified) {
+                continue;
+            }
+            watch.modified = modified;
+            std::vector<PipelineFactory> factories;
+            for (Target const& target : watch.targets) {
+                factories.push_back(target.factory);
+            }
+            lock.unlock();
+
+            std::ifstream file(watch.path, std::ios::binary);
+            std::stringstream source;
+            source << file.rdbuf();
+            std::vector<RenderPipeline> pipelines = build(watch, factories, source.str());
+
+            lock.lock();
+            if (pipelines.empty()) {
+                continue;
+            }
+            for (size_t j = 0; j < pipelines.size(); j++) {
+                watch.targets[j].pending = pipelines[j];
+            }
+            watch.reloaded = true;
+            if (this->on_reload) {
+                lock.unlock();
+                this->on_reload();
+                lock.lock();
+            }
+        }
+    }
+}
+
+std::vector<RenderPipeline> ShaderWatcher::build(Watch const& watch,
+                                                 std::vector<PipelineFactory> const& factories,
+                                                 std::string const& source) {
+    auto start = std::chrono::steady_clock::now();
+    Instance instance = this->device.GetAdapter().GetInstance();
+
+    ShaderModuleWGSLDescriptor wgsl_desc;
+    wgsl_desc.code = source.c_str();
+    ShaderModuleDescriptor module_desc{
+        .nextInChain = &wgsl_desc,
+        .label = watch.name.c_str(),
+    };
+    ShaderModule module = this->device.CreateShaderModule(&module_desc);
+
+    bool compiled = true;
+    FutureWaitInfo compilation{
+        .future = module.GetCompilationInfo(
+            CallbackMode::WaitAnyOnly,
+            [&](CompilationInfoRequestStatus status, CompilationInfo const* info) {
+                if (status != CompilationInfoRequestStatus::Success) {
+                    compiled = false;
+                    return;
+                }
+                for (size_t i = 0; i < info->messageCount; i++) {
+                    CompilationMessage const& message = info->messages[i];
+                    compiled &= message.type != CompilationMessageType::Error;
+                    std::cout << watch.path.string() << ":" << message.lineNum << ":"
+                              << message.linePos << ": " << message.message << "\n";
+                }
+            }),
+    };
+    instance.WaitAny(1, &compilation, UINT64_MAX);
+
+    std::vector<RenderPipeline> pipelines(factories.size());
+    std::vector<FutureWaitInfo> created;
+    if (compiled) {
+        // the variants of one shader compile in parallel
+        for (size_t i = 0; i < factories.size(); i++) {
+            Future future = factories[i](
+                module, CallbackMode::WaitAnyOnly,
+                [&pipelines, i](RenderPipeline pipeline) { pipelines[i] = pipeline; });
+            created.push_back({.future = future});
+        }
+        for (FutureWaitInfo& wait_info : created) {
+            instance.WaitAny(1, &wait_info, UINT64_MAX);
+        }
+    }
+    if (!compiled || std::find(pipelines.begin(), pipelines.end(), nullptr) != pipelines.end()) {
+        std::cout << "Keeping the previous " << watch.name << " pipelines\n";
+        return {};
+    }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Reloaded " << watch.path.string() << " in " << elapsed.count() << " ms\n";
+    return pipelines;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Receives the created pipeline, null when creation failed.
+using PipelineCallback = std::function<void(wgpu::RenderPipeline)>;
+
+// Starts creating the pipeline of a shader module with CreateRenderPipelineAsync in mode.
+using PipelineFactory =
+    std::function<wgpu::Future(wgpu::ShaderModule, wgpu::CallbackMode, PipelineCallback)>;
+
+// Hot reload of shaders/*.wgsl. A background thread polls the files; a changed source is compiled
+// and its pipeline created on that thread, so the render loop never waits for it. The new pipeline
+// replaces the old one in apply(), at a frame boundary; sources that fail to compile are reported
+// and leave the running pipeline alone. The device must have been created with
+// FeatureName::ImplicitDeviceSynchronization, as it is used from both threads.
+class ShaderWatcher {
+public:
+    // on_reload: called on the watcher thread when a pipeline is ready to be applied.
+    ShaderWatcher(wgpu::Device device, std::filesystem::path directory,
+                  std::function<void()> on_reload = {});
+
+    // Stops the watcher thread, pipelines not applied yet are dropped.
+    ~ShaderWatcher();
+
+    // Render thread. name: file name in the directory without .wgsl. pipeline is replaced by
+    // apply(). Several pipelines may watch one file, it is compiled once for all. Pipelines added
+    // after the file was reloaded are rebuilt from it, together with the others, on the next poll.
+    void watch(char const* name, PipelineFactory factory, wgpu::RenderPipeline* pipeline);
+
+    void start();
+
+    // Render thread, between frames. Swaps in the pipelines built since the last call and returns
+    // true when there were any.
+    bool apply();
+
+private:
+    struct Target {
+        PipelineFactory factory;
+        wgpu::RenderPipeline* pipeline = nullptr;
+        // built, waiting for apply(); guarded by mutex
+        wgpu::RenderPipeline pending;
+    };
+
+    struct Watch {
+        std::string name;
+        std::filesystem::path path;
+        // false when the file was missing at watch(), it is not polled then
+        bool available = true;
+        // the running pipelines come from the file rather than the embedded source
+        bool reloaded = false;
+        std::filesystem::file_time_type modified;
+        std::vector<Target> targets;
+    };
+
+    void run();
+
+    // Watcher thread. Returns the pipelines of source in the order of factories, empty when it
+    // doesn't compile or any of them fails.
+    std::vector<wgpu::RenderPipeline> build(Watch const& watch,
+                                            std::vector<PipelineFactory> const& factories,
+                                            std::string const& source);
+
+    wgpu::Device device;
+    std::filesystem::path directory;
+    std::function<void()> on_reload;
+
+    std::mutex mutex;
+    // guarded by mutex, name and path never change
+    std::vector<std::unique_ptr<Watch>> watches;
+    std::condition_variable stop_requested;
+    bool stopping = false;
+    std::thread thread;
+};
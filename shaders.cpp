@@ -0,0 +1,33 @@
+#include "shaders.h"
+
+#include <cstring>
+#include <iostream>
+
+#ifndef DAWN_REVISION
+#define DAWN_REVISION "unknown"
+#endif
+
+using namespace wgpu;
+
+ShaderModule create_shader_module(Device device, BackendType backend,
+                                  EmbeddedShader const& shader) {
+    ShaderModuleWGSLDescriptor wgsl_desc;
+    wgsl_desc.code = shader.wgsl;
+    ShaderModuleSPIRVDescriptor spirv_desc;
+    spirv_desc.codeSize = static_cast<uint32_t>(shader.spirv_size);
+    spirv_desc.code = shader.spirv;
+
+    ShaderModuleDescriptor module_desc{
+        .nextInChain = &wgsl_desc,
+        .label = shader.name,
+    };
+    if (backend == BackendType::Vulkan && shader.spirv_size > 0) {
+        if (std::strcmp(shader.spirv_dawn_revision, DAWN_REVISION) == 0) {
+            module_desc.nextInChain = &spirv_desc;
+        } else {
+            std::cout << "SPIR-V of " << shader.name << " is from Dawn "
+                      << shader.spirv_dawn_revision << ", using the WGSL\n";
+        }
+    }
+    return device.CreateShaderModule(&module_desc);
+}
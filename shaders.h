@@ -0,0 +1,28 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// A shader of shaders/, embedded at build time after Tint validated it, together with Tint's
+// SPIR-V translation unless the shader has override constants. Generated by
+// cmake/embed_shader.cmake.
+struct EmbeddedShader {
+    char const* name;
+    char const* wgsl;
+    uint32_t const* spirv;
+    // in words
+    size_t spirv_size;
+    // of the Tint that made the SPIR-V, null without
+    char const* spirv_dawn_revision;
+};
+
+extern EmbeddedShader const canvas_shader;
+extern EmbeddedShader const ui_shader;
+
+// Vulkan devices get the SPIR-V, Dawn then reads it instead of the WGSL; no gain has been
+// measured. The WGSL is used on other backends and when the SPIR-V comes from another Dawn
+// revision than the one built in.
+wgpu::ShaderModule create_shader_module(wgpu::Device device, wgpu::BackendType backend,
+                                        EmbeddedShader const& shader);
@@ -0,0 +1,24 @@
+// Canvas content, generated entirely on the GPU from the view parameters: a red background with
+// a 50x50 blue outline that slides horizontally with t.
+
+// (render width, render height, t, render scale)
+@group(0) @binding(0) var<uniform> params: vec4f;
+
+@vertex fn vertexMain(@builtin(vertex_index) i : u32) ->
+  @builtin(position) vec4f {
+    const pos = array(vec2f(-1, -1), vec2f(3, -1), vec2f(-1, 3));
+    return vec4f(pos[i], 0, 1);
+}
+
+@fragment fn fragmentMain(@builtin(position) frag_coord: vec4f) -> @location(0) vec4f {
+    // layout in unscaled item pixels
+    let width = params.x / params.w;
+    let origin = vec2f(25.0 + fract(params.z) * max(width - 76.0, 0.0), 25.0);
+    let p = floor(frag_coord.xy / params.w) - origin;
+    let inside = all(p >= vec2f(0.0)) && all(p <= vec2f(50.0));
+    let border = any(p == vec2f(0.0)) || any(p == vec2f(50.0));
+    if (inside && border) {
+        return vec4f(0, 0, 1, 1);
+    }
+    return vec4f(1, 0, 0, 1);
+}
@@ -0,0 +1,89 @@
+// UI pass of ImGuiWebGPU.
+
+struct Vertex {
+    @location(0) ss_pos: vec2f,
+    @location(1) uv: vec2f,
+    @location(2) color: vec4f,
+};
+
+// see CompactDrawVert
+struct CompactVertex {
+    @location(0) ss_pos_fixed: vec2i,
+    @location(1) uv: vec2f,
+    @location(2) color: vec4f,
+};
+
+struct VertexOutput {
+    @builtin(position) position: vec4f,
+    @location(0) uv: vec2f,
+    @location(1) color: vec4f,
+};
+
+// Set per pipeline variant, see ImGuiWebGPU::get_variant(). The untaken branches are compiled out.
+// The sampled texel is linear
+override texture_is_srgb: bool = false;
+// The output is encoded to sRGB when stored
+override target_is_srgb: bool = false;
+// Single channel coverage (font atlas), sampled as (1, 1, 1, r)
+override texture_is_alpha: bool = false;
+
+// (width, height, 1.0/width, 1.0/height)
+@group(0) @binding(0) var<uniform> view_info: vec4f;
+
+fn transform(vertex: Vertex) -> VertexOutput {
+    var out: VertexOutput;
+
+    var cs_pos = 2.0 * (vertex.ss_pos * view_info.zw) - 1.0;
+    cs_pos.y = -cs_pos.y;
+    out.position = vec4f(cs_pos, 0.0, 1.0);
+    out.uv = vertex.uv;
+    out.color = vertex.color;
+
+    return out;
+}
+
+@vertex fn vertexMain(vertex: Vertex) -> VertexOutput {
+    return transform(vertex);
+}
+
+// entry points can't call each other
+@vertex fn vertexMainCompact(vertex: CompactVertex) -> VertexOutput {
+    return transform(Vertex(vec2f(vertex.ss_pos_fixed) * 0.25, vertex.uv, vertex.color));
+}
+
+@group(0) @binding(1) var draw_sampler: sampler;
+@group(1) @binding(0) var draw_texture: texture_2d<f32>;
+
+struct FragmentInput {
+    @builtin(position) position: vec4f,
+    @location(0) uv: vec2f,
+    @location(1) color: vec4f,
+};
+
+fn srgb_to_linear(color: vec3f) -> vec3f {
+    let cutoff = color <= vec3f(0.04045);
+    return select(pow((color + 0.055) / 1.055, vec3f(2.4)), color / 12.92, cutoff);
+}
+
+fn linear_to_srgb(color: vec3f) -> vec3f {
+    let cutoff = color <= vec3f(0.0031308);
+    return select(1.055 * pow(color, vec3f(1.0 / 2.4)) - 0.055, color * 12.92, cutoff);
+}
+
+// ImGui colors are sRGB encoded, blending happens in the space of the target.
+@fragment fn fragmentMain(fragment: FragmentInput) -> @location(0) vec4f {
+    var texel = textureSample(draw_texture, draw_sampler, fragment.uv);
+    if (texture_is_alpha) {
+        texel = vec4f(1.0, 1.0, 1.0, texel.r);
+    }
+    var color = fragment.color;
+    if (target_is_srgb) {
+        color = vec4f(srgb_to_linear(color.rgb), color.a);
+        if (!texture_is_srgb) {
+            texel = vec4f(srgb_to_linear(texel.rgb), texel.a);
+        }
+    } else if (texture_is_srgb) {
+        texel = vec4f(linear_to_srgb(texel.rgb), texel.a);
+    }
+    return color * texel;
+}
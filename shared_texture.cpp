@@ -0,0 +1,293 @@
+#include "shared_texture.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+
+#include "allocation_counter.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <gbm.h>
+#include <unistd.h>
+#endif
+
+using namespace wgpu;
+
+#ifdef __linux__
+
+// PCI id of a render node as in sysfs, 0 when it has none.
+static uint32_t read_render_node_id(int minor, char const* name) {
+    char path[96];
+    std::snprintf(path, sizeof(path), "/sys/class/drm/renderD%d/device/%s", minor, name);
+    FILE* file = std::fopen(path, "r");
+    if (!file) {
+        return 0;
+    }
+    unsigned int id = 0;
+    if (std::fscanf(file, "%x", &id) != 1) {
+        id = 0;
+    }
+    std::fclose(file);
+    return id;
+}
+
+// The render node of the adapter's GPU, the first one when none matches.
+static int open_render_node(Device device) {
+    AdapterInfo info;
+    device.GetAdapter().GetInfo(&info);
+    int fallback = -1;
+    for (int minor = 128; minor < 136; minor++) {
+        char path[32];
+        std::snprintf(path, sizeof(path), "/dev/dri/renderD%d", minor);
+        int fd = open(path, O_RDWR | O_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        if (read_render_node_id(minor, "vendor") == info.vendorID &&
+            read_render_node_id(minor, "device") == info.deviceID) {
+            if (fallback >= 0) {
+                close(fallback);
+            }
+            return fd;
+        }
+        if (fallback < 0) {
+            fallback = fd;
+        } else {
+            close(fd);
+        }
+    }
+    return fallback;
+}
+
+SharedTextureDevice::SharedTextureDevice(Device device) : device(device) {
+    for (FeatureName feature : required_features) {
+        if (!device.HasFeature(feature)) {
+            std::cout << "Views can't be shared: the device lacks dma-buf shared texture memory "
+                         "or sync fd fences\n";
+            return;
+        }
+    }
+    this->render_node = open_render_node(device);
+    if (this->render_node < 0) {
+        std::cout << "Views can't be shared: no DRM render node\n";
+        return;
+    }
+    this->gbm = gbm_create_device(this->render_node);
+    if (!this->gbm) {
+        std::cout << "Views can't be shared: no GBM device\n";
+    }
+}
+
+SharedTextureDevice::~SharedTextureDevice() {
+    if (this->gbm) {
+        gbm_device_destroy(this->gbm);
+    }
+    if (this->render_node >= 0) {
+        close(this->render_node);
+    }
+}
+
+// across all views, the consumer caches its imports by id
+static std::atomic<uint32_t> next_buffer_id = 1;
+
+bool SharedTargets::create(Target& target, uint32_t width, uint32_t height) {
+    // The driver picks a layout its OpenGL and Vulkan drivers both import. Layouts with auxiliary
+    // planes (compression) would need every plane passed along, linear is the fallback.
+    gbm_device* gbm = this->device->get_gbm();
+    gbm_bo* bo = gbm_bo_create(gbm, width, height, GBM_FORMAT_ARGB8888, GBM_BO_USE_RENDERING);
+    if (bo && gbm_bo_get_plane_count(bo) != 1) {
+        gbm_bo_destroy(bo);
+        bo = nullptr;
+    }
+    if (!bo) {
+        bo = gbm_bo_create(gbm, width, height, GBM_FORMAT_ARGB8888,
+                           GBM_BO_USE_RENDERING | GBM_BO_USE_LINEAR);
+    }
+    int fd = bo ? gbm_bo_get_fd(bo) : -1;
+    if (fd < 0) {
+        std::cout << "Shared target allocation of " << width << "x" << height << " failed\n";
+        if (bo) {
+            gbm_bo_destroy(bo);
+        }
+        return false;
+    }
+
+    target.bo = bo;
+    target.buffer = {
+        .id = next_buffer_id++,
+        .generation = this->generation,
+        .fd = fd,
+        .width = width,
+        .height = height,
+        .drm_format = GBM_FORMAT_ARGB8888,
+        .drm_modifier = gbm_bo_get_modifier(bo),
+        .offset = gbm_bo_get_offset(bo, 0),
+        .stride = gbm_bo_get_stride(bo),
+    };
+
+    // Dawn imports a duplicate of the fd
+    SharedTextureMemoryDmaBufPlane plane{
+        .fd = fd,
+        .offset = target.buffer.offset,
+        .stride = target.buffer.stride,
+    };
+    SharedTextureMemoryDmaBufDescriptor dma_buf_desc;
+    dma_buf_desc.size = {.width = width, .height = height};
+    dma_buf_desc.drmFormat = target.buffer.drm_format;
+    dma_buf_desc.drmModifier = target.buffer.drm_modifier;
+    dma_buf_desc.planeCount = 1;
+    dma_buf_desc.planes = &plane;
+    SharedTextureMemoryDescriptor memory_desc{
+        .nextInChain = &dma_buf_desc,
+        .label = "shared view target",
+    };
+    target.memory = this->device->get_device().ImportSharedTextureMemory(&memory_desc);
+
+    // ARGB8888 is BGRA8Unorm in memory
+    TextureDescriptor texture_desc{
+        .label = "view target",
+        .usage = TextureUsage::RenderAttachment | TextureUsage::CopySrc,
+        .size = {.width = width, .height = height},
+        .format = TextureFormat::BGRA8Unorm,
+    };
+    target.texture = target.memory.CreateTexture(&texture_desc);
+    target.view = target.texture.CreateView();
+    target.initialized = false;
+    target.with_consumer = false;
+    return true;
+}
+
+void SharedTargets::destroy(Target& target) {
+    if (!target.bo) {
+        return;
+    }
+    // Dawn keeps what in-flight work uses, the consumer its own import
+    close(target.buffer.fd);
+    gbm_bo_destroy(target.bo);
+    target = Target();
+}
+
+void SharedTargets::release(uint32_t id, int fence_fd) {
+    for (Target& target : this->targets) {
+        if (!target.bo || target.buffer.id != id || !target.with_consumer) {
+            continue;
+        }
+        target.with_consumer = false;
+        if (fence_fd >= 0) {
+            WebGPUAllocations webgpu;
+            // Dawn imports a duplicate of the fd
+            SharedFenceVkSemaphoreSyncFDDescriptor sync_fd_desc;
+            sync_fd_desc.handle = fence_fd;
+            SharedFenceDescriptor fence_desc{.nextInChain = &sync_fd_desc};
+            target.released = this->device->get_device().ImportSharedFence(&fence_desc);
+        }
+        break;
+    }
+    close_fence(fence_fd);
+}
+
+SharedFrame SharedTargets::end_access(Target& target, uint32_t width, uint32_t height) {
+    SharedFrame frame{
+        .buffer = target.buffer,
+        .width = width,
+        .height = height,
+        .fence_fd = -1,
+    };
+    {
+        WebGPUAllocations webgpu;
+        SharedTextureMemoryEndAccessState state;
+        target.memory.EndAccess(target.texture, &state);
+        target.initialized = state.initialized;
+        // a single semaphore, signaled by the submission that used the target last
+        if (state.fenceCount > 0) {
+            SharedFenceVkSemaphoreSyncFDExportInfo sync_fd;
+            SharedFenceExportInfo info{.nextInChain = &sync_fd};
+            state.fences[0].ExportInfo(&info);
+            // -1 when the work already finished
+            if (sync_fd.handle >= 0) {
+                frame.fence_fd = dup(sync_fd.handle);
+            }
+        }
+    }
+    target.with_consumer = true;
+    return frame;
+}
+
+void close_fence(int fence_fd) {
+    if (fence_fd >= 0) {
+        close(fence_fd);
+    }
+}
+
+#else
+
+void close_fence(int fence_fd) {}
+
+SharedTextureDevice::SharedTextureDevice(Device device) : device(device) {
+    std::cout << "Views can't be shared: dma-buf sharing is only implemented on Linux\n";
+}
+
+SharedTextureDevice::~SharedTextureDevice() {}
+
+bool SharedTargets::create(Target& target, uint32_t width, uint32_t height) {
+    return false;
+}
+
+void SharedTargets::destroy(Target& target) {}
+
+void SharedTargets::release(uint32_t id, int fence_fd) {}
+
+SharedFrame SharedTargets::end_access(Target& target, uint32_t width, uint32_t height) {
+    return {.buffer = target.buffer, .width = width, .height = height, .fence_fd = -1};
+}
+
+#endif
+
+SharedTargets::~SharedTargets() {
+    for (Target& target : this->targets) {
+        destroy(target);
+    }
+}
+
+uint32_t SharedTargets::bucket_size(uint32_t size) {
+    return (std::max<uint32_t>(size, 1) + 63) / 64 * 64;
+}
+
+SharedTargets::Target* SharedTargets::acquire(uint32_t width, uint32_t height) {
+    width = bucket_size(width);
+    height = bucket_size(height);
+    if (width != this->width || height != this->height) {
+        for (Target& target : this->targets) {
+            destroy(target);
+        }
+        this->width = width;
+        this->height = height;
+        this->generation++;
+    }
+    // created on first use, a consumer that hands frames back right away needs two
+    for (Target& target : this->targets) {
+        if (target.with_consumer) {
+            continue;
+        }
+        if (!target.bo && !create(target, width, height)) {
+            return nullptr;
+        }
+        return &target;
+    }
+    return nullptr;
+}
+
+void SharedTargets::begin_access(Target& target) {
+    WebGPUAllocations webgpu;
+    uint64_t signaled_value = 1;
+    SharedTextureMemoryBeginAccessDescriptor begin{
+        .initialized = target.initialized,
+        .fenceCount = target.released ? 1u : 0u,
+        .fences = &target.released,
+        .signaledValues = &signaled_value,
+    };
+    target.memory.BeginAccess(target.texture, &begin);
+    target.released = nullptr;
+}
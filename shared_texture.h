@@ -0,0 +1,133 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+#include <cstdint>
+
+struct gbm_device;
+struct gbm_bo;
+
+// A render target shared with the consumer: a single plane dma-buf the consumer imports into its
+// own OpenGL context (EGL_EXT_image_dma_buf_import). fd stays owned by the render thread and is
+// only valid during the callback that delivered the frame.
+struct SharedBuffer {
+    // unique for the life of the process
+    uint32_t id;
+    // changes when the targets of a view are recreated, imports of older generations are stale
+    uint32_t generation;
+    int fd;
+    uint32_t width;
+    uint32_t height;
+    // DRM fourcc and format modifier
+    uint32_t drm_format;
+    uint64_t drm_modifier;
+    uint32_t offset;
+    uint32_t stride;
+};
+
+// A rendered frame. The consumer samples the top left width x height texels of buffer once
+// fence_fd signals, and hands the buffer back with RenderService::release_frame().
+struct SharedFrame {
+    SharedBuffer buffer;
+    uint32_t width;
+    uint32_t height;
+    // sync file signaled when the GPU finished rendering, -1 when it already has; owned by the
+    // receiver
+    int fence_fd;
+};
+
+// Closes a fence fd handed over with a frame or a release.
+void close_fence(int fence_fd);
+
+// The GBM device of the render node the WebGPU adapter runs on, allocates the dma-bufs of
+// SharedTargets. Linux only: elsewhere, or when the device lacks the dma-buf features, it is not
+// supported.
+class SharedTextureDevice {
+public:
+    // Requested by init_webgpu() when the adapter has them.
+    static constexpr wgpu::FeatureName required_features[2] = {
+        wgpu::FeatureName::SharedTextureMemoryDmaBuf,
+        wgpu::FeatureName::SharedFenceVkSemaphoreSyncFD,
+    };
+
+    explicit SharedTextureDevice(wgpu::Device device);
+
+    ~SharedTextureDevice();
+
+    SharedTextureDevice(SharedTextureDevice const&) = delete;
+    SharedTextureDevice& operator=(SharedTextureDevice const&) = delete;
+
+    // Prints the reason when it isn't.
+    bool is_supported() const {
+        return this->gbm != nullptr;
+    }
+
+    wgpu::Device get_device() const {
+        return this->device;
+    }
+
+    gbm_device* get_gbm() const {
+        return this->gbm;
+    }
+
+private:
+    wgpu::Device device;
+    int render_node = -1;
+    gbm_device* gbm = nullptr;
+};
+
+// The render targets of one view, a ring the render thread renders into and the consumer shows
+// from. A target is rendered, delivered with end_access() and held by the consumer until it comes
+// back through release(); meanwhile the next frames use the other targets. Render thread only.
+class SharedTargets {
+public:
+    static constexpr uint32_t target_count = 3;
+
+    struct Target {
+        gbm_bo* bo = nullptr;
+        SharedBuffer buffer{};
+        wgpu::SharedTextureMemory memory;
+        wgpu::Texture texture;
+        wgpu::TextureView view;
+        // signaled once the consumer stopped sampling, waited for by the next access
+        wgpu::SharedFence released;
+        bool initialized = false;
+        bool with_consumer = false;
+    };
+
+    explicit SharedTargets(SharedTextureDevice& device) : device(&device) {}
+
+    ~SharedTargets();
+
+    SharedTargets(SharedTargets const&) = delete;
+    SharedTargets& operator=(SharedTargets const&) = delete;
+
+    // Rounds sizes up so that small size changes (window resizes, dynamic resolution) keep the
+    // targets; users render into the top left corner.
+    static uint32_t bucket_size(uint32_t size);
+
+    // A target of at least width x height the consumer doesn't hold, null when it holds all of
+    // them or allocation failed. The ring is recreated when the bucket size changes.
+    Target* acquire(uint32_t width, uint32_t height);
+
+    // Call before the first command using the target is encoded.
+    void begin_access(Target& target);
+
+    // Call after the submission using the target. The target is with the consumer from now on.
+    SharedFrame end_access(Target& target, uint32_t width, uint32_t height);
+
+    // Hands a target back, fence_fd (owned, -1 for none) signals when the consumer is done with
+    // it. Ids of targets recreated since are ignored.
+    void release(uint32_t id, int fence_fd);
+
+private:
+    bool create(Target& target, uint32_t width, uint32_t height);
+
+    void destroy(Target& target);
+
+    SharedTextureDevice* device;
+    Target targets[target_count];
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t generation = 0;
+};
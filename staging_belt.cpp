@@ -0,0 +1,170 @@
+#include "staging_belt.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "allocation_counter.h"
+#include "webgpu_helpers.h"
+
+using namespace wgpu;
+
+StagingBelt::StagingBelt(Device device, uint64_t chunk_size)
+: device(device), chunk_size(chunk_size) {}
+
+StagingBelt::~StagingBelt() {
+    // the callbacks reference the chunks
+    Instance instance = this->device.GetAdapter().GetInstance();
+    for (std::unique_ptr<Chunk>& chunk : this->chunks) {
+        if (chunk->map_pending) {
+            FutureWaitInfo mapped{.future = chunk->mapped};
+            instance.WaitAny(1, &mapped, UINT64_MAX);
+        }
+    }
+}
+
+StagingBelt::Chunk* StagingBelt::acquire_chunk(uint64_t size) {
+    auto it = std::find_if(this->free_chunks.begin(), this->free_chunks.end(),
+                           [size](Chunk* chunk) { return chunk->buffer.GetSize() >= size; });
+    if (it != this->free_chunks.end()) {
+        Chunk* chunk = *it;
+        this->free_chunks.erase(it);
+        return chunk;
+    }
+
+    BufferDescriptor desc{
+        .label = "staging belt chunk",
+        .usage = BufferUsage::MapWrite | BufferUsage::CopySrc,
+        .size = std::max(this->chunk_size, align_up(size, 4)),
+        .mappedAtCreation = true,
+    };
+    std::unique_ptr<Chunk> chunk = std::make_unique<Chunk>();
+    chunk->belt = this;
+    chunk->buffer = this->device.CreateBuffer(&desc);
+    chunk->data = static_cast<uint8_t*>(chunk->buffer.GetMappedRange());
+    this->stats.peak_bytes += desc.size;
+    this->chunks.push_back(std::move(chunk));
+    return this->chunks.back().get();
+}
+
+StagingBelt::Allocation StagingBelt::allocate(uint64_t size, uint64_t alignment) {
+    alignment = std::max<uint64_t>(alignment, 4);
+    Chunk* chunk = this->open_chunks.empty() ? nullptr : this->open_chunks.back();
+    if (!chunk || align_up(chunk->used, alignment) + size > chunk->buffer.GetSize()) {
+        chunk = acquire_chunk(size);
+        this->open_chunks.push_back(chunk);
+    }
+
+    uint64_t offset = align_up(chunk->used, alignment);
+    chunk->used = offset + size;
+    this->stats.frame_bytes += size;
+    return {chunk->data + offset, chunk->buffer, offset};
+}
+
+void StagingBelt::copy(Allocation const& source, uint64_t source_offset, Buffer destination,
+                       uint64_t destination_offset, uint64_t size) {
+    if (size == 0) {
+        return;
+    }
+    Copy copy{
+        .source = source.buffer,
+        .source_offset = source.offset + source_offset,
+        .destination = destination,
+        .destination_offset = destination_offset,
+        .size = size,
+    };
+    this->copies.push_back(copy);
+}
+
+void StagingBelt::write_buffer(Buffer destination, uint64_t offset, void const* data,
+                               uint64_t size) {
+    Allocation allocation = allocate(align_up(size, 4));
+    memcpy(allocation.data, data, size);
+    copy(allocation, 0, destination, offset, align_up(size, 4));
+}
+
+void StagingBelt::write_texture(ImageCopyTexture const& destination, void const* data,
+                                uint32_t bytes_per_row, Extent3D size) {
+    // buffer to texture copies need rows aligned to 256 bytes
+    uint32_t row_size = size.width * texture_format_size(destination.texture.GetFormat());
+    uint32_t staging_bytes_per_row = align_up(row_size, 256);
+    uint32_t rows = size.height * size.depthOrArrayLayers;
+    Allocation allocation = allocate(uint64_t(staging_bytes_per_row) * rows, 16);
+    for (uint32_t row = 0; row < rows; row++) {
+        memcpy(allocation.data + uint64_t(row) * staging_bytes_per_row,
+               static_cast<uint8_t const*>(data) + uint64_t(row) * bytes_per_row, row_size);
+    }
+
+    Copy copy{
+        .source = allocation.buffer,
+        .source_offset = allocation.offset,
+        .destination_texture = destination,
+        .bytes_per_row = staging_bytes_per_row,
+        .extent = size,
+    };
+    this->copies.push_back(copy);
+}
+
+CommandBuffer StagingBelt::finish() {
+    for (Chunk* chunk : this->open_chunks) {
+        {
+            WebGPUAllocations webgpu;
+            chunk->buffer.Unmap();
+        }
+        chunk->data = nullptr;
+        chunk->finished = std::chrono::steady_clock::now();
+        this->finished_chunks.push_back(chunk);
+    }
+    this->open_chunks.clear();
+
+    WebGPUAllocations webgpu;
+    CommandEncoder encoder = this->device.CreateCommandEncoder();
+    for (Copy const& copy : this->copies) {
+        if (copy.destination_texture.texture) {
+            ImageCopyBuffer source{
+                .layout =
+                    {
+                        .offset = copy.source_offset,
+                        .bytesPerRow = copy.bytes_per_row,
+                        .rowsPerImage = copy.extent.height,
+                    },
+                .buffer = copy.source,
+            };
+            encoder.CopyBufferToTexture(&source, &copy.destination_texture, &copy.extent);
+        } else {
+            encoder.CopyBufferToBuffer(copy.source, copy.source_offset, copy.destination,
+                                       copy.destination_offset, copy.size);
+        }
+    }
+    this->copies.clear();
+    this->stats.frame_bytes = 0;
+    return encoder.Finish();
+}
+
+void StagingBelt::recall() {
+    for (Chunk* chunk : this->finished_chunks) {
+        chunk->map_pending = true;
+        WebGPUAllocations webgpu;
+        chunk->mapped = chunk->buffer.MapAsync(
+            MapMode::Write, 0, chunk->buffer.GetSize(), CallbackMode::AllowProcessEvents,
+            // captureless with userdata, a capturing lambda would be copied to the heap
+            [](MapAsyncStatus status, char const* message, Chunk* chunk) {
+                chunk->map_pending = false;
+                if (status != MapAsyncStatus::Success) {
+                    std::cout << "Staging chunk mapping error: " << status << "\n";
+                    return;
+                }
+                chunk->data = static_cast<uint8_t*>(chunk->buffer.GetMappedRange());
+                chunk->used = 0;
+                StagingBelt* belt = chunk->belt;
+                belt->free_chunks.push_back(chunk);
+
+                std::chrono::duration<double, std::milli> latency =
+                    std::chrono::steady_clock::now() - chunk->finished;
+                belt->stats.last_recycle_ms = latency.count();
+                belt->stats.max_recycle_ms = std::max(belt->stats.max_recycle_ms, latency.count());
+            },
+            chunk);
+    }
+    this->finished_chunks.clear();
+}
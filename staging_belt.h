@@ -0,0 +1,99 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Upload path for buffer and texture data. Data is written into large MapWrite chunks that are
+// sub-allocated linearly; the copies into their destinations are batched into one command buffer
+// per frame. Once the GPU is done with a chunk it is mapped again and reused, so after warm up no
+// staging memory is allocated.
+class StagingBelt {
+public:
+    struct Allocation {
+        uint8_t* data = nullptr;
+        wgpu::Buffer buffer;
+        uint64_t offset = 0;
+    };
+
+    struct Stats {
+        // total size of all chunks, which are never released before the belt
+        uint64_t peak_bytes = 0;
+        uint64_t frame_bytes = 0;
+        // time from finish() until a chunk is writable again
+        double last_recycle_ms = 0.0;
+        double max_recycle_ms = 0.0;
+    };
+
+    StagingBelt(wgpu::Device device, uint64_t chunk_size = 1 << 20);
+
+    // Waits for pending chunk mappings.
+    ~StagingBelt();
+
+    // size bytes of mapped memory, valid until finish(). offset is a multiple of alignment, a
+    // power of two of at least 4.
+    Allocation allocate(uint64_t size, uint64_t alignment = 4);
+
+    // Records the copy of part of an allocation. Offsets and size must be multiples of 4.
+    void copy(Allocation const& source, uint64_t source_offset, wgpu::Buffer destination,
+              uint64_t destination_offset, uint64_t size);
+
+    // Replacements for Queue::WriteBuffer and Queue::WriteTexture, with the same ordering: the
+    // data lands before the work submitted after finish().
+    void write_buffer(wgpu::Buffer destination, uint64_t offset, void const* data, uint64_t size);
+
+    void write_texture(wgpu::ImageCopyTexture const& destination, void const* data,
+                       uint32_t bytes_per_row, wgpu::Extent3D size);
+
+    // Unmaps the chunks written since the last call and returns their copies. Submit it ahead of
+    // the work that reads the destinations, then call recall().
+    wgpu::CommandBuffer finish();
+
+    // Maps the chunks of the last finish() again; they are reused once their callbacks ran from
+    // Instance::ProcessEvents.
+    void recall();
+
+    Stats const& get_stats() const {
+        return this->stats;
+    }
+
+private:
+    struct Chunk {
+        // userdata of the map callback
+        StagingBelt* belt = nullptr;
+        wgpu::Buffer buffer;
+        uint8_t* data = nullptr;
+        uint64_t used = 0;
+        wgpu::Future mapped;
+        bool map_pending = false;
+        std::chrono::steady_clock::time_point finished;
+    };
+
+    struct Copy {
+        wgpu::Buffer source;
+        uint64_t source_offset;
+        // texture copy when destination_texture is set
+        wgpu::Buffer destination;
+        uint64_t destination_offset;
+        uint64_t size;
+        wgpu::ImageCopyTexture destination_texture;
+        uint32_t bytes_per_row;
+        wgpu::Extent3D extent;
+    };
+
+    Chunk* acquire_chunk(uint64_t size);
+
+    wgpu::Device device;
+    uint64_t chunk_size;
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    std::vector<Chunk*> free_chunks;
+    // written since the last finish(), the last one is sub-allocated from
+    std::vector<Chunk*> open_chunks;
+    // finished, waiting for recall()
+    std::vector<Chunk*> finished_chunks;
+    std::vector<Copy> copies;
+    Stats stats;
+};
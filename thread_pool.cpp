@@ -0,0 +1,95 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    return pool;
+}
+
+ThreadPool::ThreadPool(uint32_t worker_count) {
+    for (uint32_t i = 0; i < worker_count; i++) {
+        this->workers.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->work_available.notify_all();
+    for (std::thread& worker : this->workers) {
+        worker.join();
+    }
+}
+
+uint32_t ThreadPool::run_items(void (*func)(uint32_t, void*), void* user_data, uint32_t count) {
+    uint32_t ran = 0;
+    for (uint32_t i = this->next_item++; i < count; i = this->next_item++) {
+        func(i, user_data);
+        ran++;
+    }
+    return ran;
+}
+
+void ThreadPool::parallel_for(uint32_t count, void (*func)(uint32_t index, void* user_data),
+                              void* user_data) {
+    if (this->workers.empty() || count <= 1) {
+        for (uint32_t i = 0; i < count; i++) {
+            func(i, user_data);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> loop_lock(this->loop_mutex);
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->func = func;
+        this->user_data = user_data;
+        this->count = count;
+        this->next_item = 0;
+        this->finished_items = 0;
+        this->generation++;
+    }
+    this->work_available.notify_all();
+
+    uint32_t ran = run_items(func, user_data, count);
+
+    // Late workers must have left the loop before its state is reused by the next one.
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->finished_items += ran;
+    this->work_done.wait(lock, [this] {
+        return this->finished_items == this->count && this->active_workers == 0;
+    });
+    this->func = nullptr;
+    this->user_data = nullptr;
+}
+
+void ThreadPool::work() {
+    uint64_t seen_generation = 0;
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (true) {
+        this->work_available.wait(lock, [&] {
+            return this->stopping || (this->func && this->generation != seen_generation);
+        });
+        if (this->stopping) {
+            return;
+        }
+        seen_generation = this->generation;
+        void (*func)(uint32_t, void*) = this->func;
+        void* user_data = this->user_data;
+        uint32_t count = this->count;
+        this->active_workers++;
+        lock.unlock();
+
+        uint32_t ran = run_items(func, user_data, count);
+
+        lock.lock();
+        this->finished_items += ran;
+        this->active_workers--;
+        if (this->finished_items == this->count && this->active_workers == 0) {
+            this->work_done.notify_all();
+        }
+    }
+}
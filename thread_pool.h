@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data parallel loops.
+class ThreadPool {
+public:
+    // Shared pool with one worker less than there are cores, the calling thread takes part too.
+    static ThreadPool& instance();
+
+    explicit ThreadPool(uint32_t worker_count);
+
+    ~ThreadPool();
+
+    // Calls func(i, user_data) for every i in [0, count) on the workers and the calling thread,
+    // returns once all calls finished. One loop runs at a time; concurrent callers wait for each
+    // other. Nothing is allocated, the frame path runs loops.
+    void parallel_for(uint32_t count, void (*func)(uint32_t index, void* user_data), void* user_data);
+
+    // Calls func(i); func is referenced, not copied into a std::function.
+    template <typename F>
+    void parallel_for(uint32_t count, F const& func) {
+        parallel_for(
+            count, [](uint32_t index, void* user_data) { (*static_cast<F const*>(user_data))(index); },
+            const_cast<F*>(&func));
+    }
+
+    uint32_t get_worker_count() const {
+        return static_cast<uint32_t>(this->workers.size());
+    }
+
+private:
+    void work();
+
+    // Runs items of the current loop until none are left, returns how many it ran.
+    uint32_t run_items(void (*func)(uint32_t, void*), void* user_data, uint32_t count);
+
+    std::vector<std::thread> workers;
+    std::mutex loop_mutex;
+
+    std::mutex mutex;
+    std::condition_variable work_available;
+    std::condition_variable work_done;
+    bool stopping = false;
+    uint64_t generation = 0;
+    void (*func)(uint32_t, void*) = nullptr;
+    void* user_data = nullptr;
+    uint32_t count = 0;
+    std::atomic<uint32_t> next_item = 0;
+    uint32_t finished_items = 0;
+    // workers that joined the current loop and haven't reported back yet
+    uint32_t active_workers = 0;
+};
@@ -1,6 +1,114 @@
 #include "webgpu_helpers.h"
 
+#include <dawn/native/DawnNative.h>
+
 #include <cassert>
+#include <thread>
+
+#include "allocation_counter.h"
+#include "blob_cache.h"
+#include "shared_texture.h"
+
+// Software adapters can take seconds to create a device.
+static constexpr uint64_t gpu_request_timeout_ns = 10'000'000'000;
+
+GPU init_webgpu(bool multithreaded) {
+    GPU gpu{};
+    // shaders and pipelines are cached on disk
+    dawn::native::DawnInstanceDescriptor dawn_instance_desc;
+    dawn_instance_desc.platform = &BlobCachePlatform::instance();
+    wgpu::InstanceDescriptor instance_desc{
+        .nextInChain = &dawn_instance_desc,
+        .features = {.timedWaitAnyEnable = true},
+    };
+    gpu.instance = wgpu::CreateInstance(&instance_desc);
+
+    wgpu::RequestAdapterOptions options = {
+        .compatibleSurface = nullptr,
+        .powerPreference = wgpu::PowerPreference::HighPerformance,
+        .forceFallbackAdapter = false,
+        .compatibilityMode = false,
+    };
+    wgpu::FutureWaitInfo adapter_future;
+    adapter_future.future = gpu.instance.RequestAdapter(&options, wgpu::CallbackMode::WaitAnyOnly,
+        [&gpu] (wgpu::RequestAdapterStatus status, wgpu::Adapter adapter, char const* message) {
+            if (status != wgpu::RequestAdapterStatus::Success) {
+                std::cout << "No adapter: " << (message ? message : "") << "\n";
+                return;
+            }
+            gpu.adapter = adapter;
+    });
+
+    auto status = gpu.instance.WaitAny(1, &adapter_future, gpu_request_timeout_ns);
+    if (status != wgpu::WaitStatus::Success || !gpu.adapter) {
+        if (status == wgpu::WaitStatus::TimedOut) {
+            std::cout << "Adapter request timed out\n";
+        }
+        return gpu;
+    }
+
+    BlobCachePlatform::instance().get_cache().open(gpu.adapter);
+
+    wgpu::DeviceDescriptor device_desc;
+    wgpu::FeatureName features[4];
+    // optional, used to measure GPU frame time for dynamic resolution
+    if (gpu.adapter.HasFeature(wgpu::FeatureName::TimestampQuery)) {
+        features[device_desc.requiredFeatureCount++] = wgpu::FeatureName::TimestampQuery;
+    }
+    wgpu::FeatureName synchronization = wgpu::FeatureName::ImplicitDeviceSynchronization;
+    if (multithreaded && gpu.adapter.HasFeature(synchronization)) {
+        features[device_desc.requiredFeatureCount++] = synchronization;
+    }
+    // views are handed to the consumer as dma-bufs, the render service fails without them
+    bool shareable = true;
+    for (wgpu::FeatureName feature : SharedTextureDevice::required_features) {
+        shareable &= gpu.adapter.HasFeature(feature);
+    }
+    if (shareable) {
+        for (wgpu::FeatureName feature : SharedTextureDevice::required_features) {
+            features[device_desc.requiredFeatureCount++] = feature;
+        }
+    }
+    device_desc.requiredFeatures = features;
+    device_desc.deviceLostCallbackInfo = {
+            .callback = [](WGPUDevice const * device, WGPUDeviceLostReason reason, char const * message, void *) {
+                std::cout << "Device Lost: " << message << "\n";
+            },
+    };
+    device_desc.uncapturedErrorCallbackInfo = {
+            .callback = [](WGPUErrorType type, char const * message, void *) {
+                std::cout << "Error: " << message << "\n";
+            },
+    };
+    wgpu::FutureWaitInfo device_future;
+    device_future.future = gpu.adapter.RequestDevice(&device_desc, wgpu::CallbackMode::WaitAnyOnly,
+        [&gpu](wgpu::RequestDeviceStatus status, wgpu::Device device, char const* message) {
+            if (status != wgpu::RequestDeviceStatus::Success) {
+                std::cout << "No device: " << (message ? message : "") << "\n";
+                return;
+            }
+            gpu.device = device;
+        });
+    status = gpu.instance.WaitAny(1, &device_future, gpu_request_timeout_ns);
+    if (status == wgpu::WaitStatus::TimedOut) {
+        // a WaitAnyOnly callback won't run successfully after this
+        std::cout << "Device request timed out\n";
+    }
+
+    return gpu;
+}
+
+void wait_for_queue(GPU const & gpu) {
+    bool done = false;
+    gpu.device.GetQueue().OnSubmittedWorkDone(wgpu::CallbackMode::AllowProcessEvents,
+        [&done](wgpu::QueueWorkDoneStatus status) {
+            done = true;
+        });
+    while (!done) {
+        gpu.instance.ProcessEvents();
+        std::this_thread::yield();
+    }
+}
 
 uint32_t texture_format_size(wgpu::TextureFormat format) {
     switch (format) {
@@ -174,60 +282,228 @@ uint64_t get_buffer_size_for_texture_copy(wgpu::Texture texture, uint32_t& row_s
     return row_stride * texture.GetHeight();
 }
 
-wgpu::ImageCopyBuffer image_copy_buffer_for_texture(const wgpu::Texture & texture, uint64_t & size) {
-    uint32_t row_stride = align_up<uint32_t>(texture.GetWidth() * texture_format_size(texture.GetFormat()), 256);
-    size = row_stride * texture.GetHeight();
+wgpu::ImageCopyBuffer image_copy_buffer_for_texture(const wgpu::Texture & texture, uint32_t width, uint32_t height, uint64_t & size) {
+    uint32_t row_stride = align_up<uint32_t>(width * texture_format_size(texture.GetFormat()), 256);
+    size = row_stride * height;
     wgpu::ImageCopyBuffer icb{
         .layout = {
             .offset = 0,
             .bytesPerRow = row_stride,
-            .rowsPerImage = texture.GetHeight(),
+            .rowsPerImage = height,
         },
         .buffer = nullptr,
     };
     return icb;
 }
 
-void TextureCapture::pop() {
-    Capture& capture = this->captures[this->tail];
+FrameTracker::FrameTracker(GPU const & gpu, uint32_t frames_in_flight)
+: instance(gpu.instance), queue(gpu.device.GetQueue()), frames_in_flight(frames_in_flight) {
+    assert(frames_in_flight >= 1 && frames_in_flight <= max_frames_in_flight);
+}
 
-    if (capture.buffer && capture.buffer.GetMapState() == wgpu::BufferMapState::Unmapped) {
-        wgpu::FutureWaitInfo read_back_info;
-        read_back_info.future = capture.buffer.MapAsync(wgpu::MapMode::Read, 0, capture.buffer.GetSize(), wgpu::CallbackMode::AllowSpontaneous,
-            [&capture](wgpu::MapAsyncStatus status, char const * message) {
-                if (status != wgpu::MapAsyncStatus::Success) {
-                    std::cout << "Buffer mapping error: " << status << "\n";
-                    return;
-                }
+FrameTracker::~FrameTracker() {
+    for (uint32_t i = 0; i < this->frames_in_flight; i++) {
+        wait_for_slot(i);
+    }
+}
 
-                char const * data = reinterpret_cast<char const *>(capture.buffer.GetConstMappedRange());
-                capture.callback(data, capture.layout);
+uint32_t FrameTracker::begin_frame() {
+    this->slot = this->frame_index % this->frames_in_flight;
+    wait_for_slot(this->slot);
+    return this->slot;
+}
 
-                capture.buffer.Unmap();
+void FrameTracker::end_frame() {
+    WebGPUAllocations webgpu;
+    this->fences[this->slot] = this->queue.OnSubmittedWorkDone(wgpu::CallbackMode::WaitAnyOnly,
+        [](wgpu::QueueWorkDoneStatus status) {
+            if (status != wgpu::QueueWorkDoneStatus::Success) {
+                std::cout << "Queue work done error: " << status << "\n";
             }
-        );
-        auto status = this->device.GetAdapter().GetInstance().WaitAny(1, &read_back_info, 0);
-        if (status != wgpu::WaitStatus::Success || !read_back_info.completed) {
-            std::cout << "WaitAny failure: " << status << ". Buffer status = " << capture.buffer.GetMapState() << "\n";
-            return; // don't advance just yet
+        });
+    this->in_flight[this->slot] = true;
+    this->frame_index++;
+}
+
+void FrameTracker::wait_for_slot(uint32_t slot) {
+    if (!this->in_flight[slot]) {
+        return;
+    }
+
+    WebGPUAllocations webgpu;
+    wgpu::FutureWaitInfo fence{.future = this->fences[slot]};
+    auto status = this->instance.WaitAny(1, &fence, UINT64_MAX);
+    if (status != wgpu::WaitStatus::Success) {
+        std::cout << "WaitAny failure: " << status << "\n";
+    }
+    this->in_flight[slot] = false;
+}
+
+GpuTimer::GpuTimer(GPU const & gpu)
+: instance(gpu.instance) {
+    if (!gpu.device.HasFeature(wgpu::FeatureName::TimestampQuery)) {
+        return;
+    }
+
+    wgpu::QuerySetDescriptor query_set_desc{
+        .label = "frame timestamps",
+        .type = wgpu::QueryType::Timestamp,
+        .count = 2 * FrameTracker::max_frames_in_flight,
+    };
+    this->query_set = gpu.device.CreateQuerySet(&query_set_desc);
+
+    // ResolveQuerySet destination offsets must be 256 byte aligned
+    wgpu::BufferDescriptor resolve_desc{
+        .label = "frame timestamps resolve",
+        .usage = wgpu::BufferUsage::QueryResolve | wgpu::BufferUsage::CopySrc,
+        .size = 256 * FrameTracker::max_frames_in_flight,
+    };
+    this->resolve_buffer = gpu.device.CreateBuffer(&resolve_desc);
+
+    for (Readback & readback : this->readbacks) {
+        wgpu::BufferDescriptor readback_desc{
+            .label = "frame timestamps readback",
+            .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::MapRead,
+            .size = 2 * sizeof(uint64_t),
+        };
+        readback.timer = this;
+        readback.buffer = gpu.device.CreateBuffer(&readback_desc);
+    }
+}
+
+void GpuTimer::write_timestamp(uint32_t index, wgpu::CommandEncoder encoder) {
+    // An empty compute pass is the portable way to write a timestamp between passes.
+    wgpu::ComputePassTimestampWrites writes{
+        .querySet = this->query_set,
+        .beginningOfPassWriteIndex = index,
+    };
+    wgpu::ComputePassDescriptor pass_desc{
+        .timestampWrites = &writes,
+    };
+    encoder.BeginComputePass(&pass_desc).End();
+}
+
+void GpuTimer::begin(uint32_t slot, wgpu::CommandEncoder encoder) {
+    if (!is_supported()) {
+        return;
+    }
+    WebGPUAllocations webgpu;
+
+    // The previous read back of this slot has to be consumed before the slot is reused.
+    wgpu::Buffer & buffer = this->readbacks[slot].buffer;
+    if (buffer.GetMapState() != wgpu::BufferMapState::Unmapped) {
+        wgpu::FutureWaitInfo info{.future = this->readbacks[slot].future};
+        this->instance.WaitAny(1, &info, UINT64_MAX);
+    }
+    if (buffer.GetMapState() != wgpu::BufferMapState::Unmapped) {
+        return;
+    }
+
+    write_timestamp(2 * slot, encoder);
+}
+
+void GpuTimer::end(uint32_t slot, wgpu::CommandEncoder encoder) {
+    if (!is_supported() || this->readbacks[slot].buffer.GetMapState() != wgpu::BufferMapState::Unmapped) {
+        return;
+    }
+    WebGPUAllocations webgpu;
+
+    write_timestamp(2 * slot + 1, encoder);
+    encoder.ResolveQuerySet(this->query_set, 2 * slot, 2, this->resolve_buffer, 256 * slot);
+    encoder.CopyBufferToBuffer(this->resolve_buffer, 256 * slot, this->readbacks[slot].buffer, 0,
+                               2 * sizeof(uint64_t));
+    this->readbacks[slot].pending = true;
+}
+
+void GpuTimer::map(uint32_t slot) {
+    Readback & readback = this->readbacks[slot];
+    if (!readback.pending) {
+        return;
+    }
+    readback.pending = false;
+
+    WebGPUAllocations webgpu;
+    readback.future = readback.buffer.MapAsync(wgpu::MapMode::Read, 0, 2 * sizeof(uint64_t), wgpu::CallbackMode::AllowProcessEvents,
+        [](wgpu::MapAsyncStatus status, char const * message, Readback * readback) {
+            if (status != wgpu::MapAsyncStatus::Success) {
+                return;
+            }
+
+            uint64_t const * timestamps = static_cast<uint64_t const *>(readback->buffer.GetConstMappedRange());
+            if (timestamps[1] > timestamps[0]) {
+                readback->timer->last_frame_ms = (timestamps[1] - timestamps[0]) * 1e-6;
+            }
+            readback->buffer.Unmap();
+        },
+        &readback
+    );
+}
+
+TextureCapture::~TextureCapture() {
+    wgpu::Instance instance = this->device.GetAdapter().GetInstance();
+    for (Capture & capture : this->captures) {
+        if (capture.buffer && capture.buffer.GetMapState() == wgpu::BufferMapState::Pending) {
+            wgpu::FutureWaitInfo mapped{.future = capture.future};
+            instance.WaitAny(1, &mapped, UINT64_MAX);
         }
     }
+}
+
+void TextureCapture::pop(uint32_t slot) {
+    Capture& capture = this->captures[slot];
+    if (!capture.pending) {
+        return;
+    }
+    capture.pending = false;
+
+    WebGPUAllocations webgpu;
+    // captureless with userdata, a capturing lambda would be copied to the heap on every map
+    capture.future = capture.buffer.MapAsync(wgpu::MapMode::Read, 0, capture.buffer.GetSize(), wgpu::CallbackMode::AllowProcessEvents,
+        [](wgpu::MapAsyncStatus status, char const * message, Capture * capture) {
+            if (status != wgpu::MapAsyncStatus::Success) {
+                std::cout << "Buffer mapping error: " << status << "\n";
+                return;
+            }
 
-    this->tail = (this->tail + 1) % this->count;
+            char const * data = reinterpret_cast<char const *>(capture->buffer.GetConstMappedRange());
+            if (*capture->callback) {
+                // what the consumer does with the pixels is not the frame's
+                UncountedAllocations uncounted;
+                (*capture->callback)(data, capture->layout);
+            }
+
+            capture->buffer.Unmap();
+        },
+        &capture
+    );
+}
+
+bool TextureCapture::wait_unmapped(Capture & capture) {
+    if (!capture.buffer || capture.buffer.GetMapState() == wgpu::BufferMapState::Unmapped) {
+        return true;
+    }
+
+    // The slot's frame has retired, so the mapping is only waiting for its callback.
+    WebGPUAllocations webgpu;
+    wgpu::FutureWaitInfo read_back_info{.future = capture.future};
+    auto status = this->device.GetAdapter().GetInstance().WaitAny(1, &read_back_info, UINT64_MAX);
+    if (status != wgpu::WaitStatus::Success || !read_back_info.completed) {
+        std::cout << "WaitAny failure: " << status << ". Buffer status = " << capture.buffer.GetMapState() << "\n";
+    }
+    return capture.buffer.GetMapState() == wgpu::BufferMapState::Unmapped;
 }
 
-void TextureCapture::encode_texture_copy(wgpu::Texture const & texture, Capture & capture, wgpu::CommandEncoder encoder) {
+void TextureCapture::encode_texture_copy(wgpu::Texture const & texture, wgpu::Extent3D size, Capture & capture, wgpu::CommandEncoder encoder) {
+    assert(size.width <= texture.GetWidth() && size.height <= texture.GetHeight());
     uint64_t required_size;
-    wgpu::ImageCopyBuffer destination = image_copy_buffer_for_texture(texture, required_size);
+    wgpu::ImageCopyBuffer destination = image_copy_buffer_for_texture(texture, size.width, size.height, required_size);
 
     uint64_t buffer_size = (capture.buffer) ? capture.buffer.GetSize() : 0;
     if (buffer_size < required_size) {
-        wgpu::BufferDescriptor desc{
-            .label = "texture capture",
-            .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::MapRead,
-            .size = required_size,
-        };
-        capture.buffer = device.CreateBuffer(&desc);
+        // unmapped, see wait_unmapped()
+        this->pool->release(capture.buffer);
+        capture.buffer = this->pool->acquire_buffer(
+            wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::MapRead, required_size, "texture capture");
     }
     assert(capture.buffer);
     destination.buffer = capture.buffer;
@@ -237,10 +513,11 @@ void TextureCapture::encode_texture_copy(wgpu::Texture const & texture, Capture
     };
 
     wgpu::Extent3D extent{
-        .width = texture.GetWidth(),
-        .height = texture.GetHeight(),
+        .width = size.width,
+        .height = size.height,
     };
 
+    WebGPUAllocations webgpu;
     bool submit = false;
     if (!encoder) {
         encoder = this->device.CreateCommandEncoder();
@@ -256,8 +533,8 @@ void TextureCapture::encode_texture_copy(wgpu::Texture const & texture, Capture
 
     capture.layout = ImageDataLayout{
       .format = texture.GetFormat(),
-      .width = texture.GetWidth(),
-      .height = texture.GetHeight(),
+      .width = size.width,
+      .height = size.height,
       .row_stride = destination.layout.bytesPerRow,
     };
 }
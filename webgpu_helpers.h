@@ -8,11 +8,37 @@
 #include <functional>
 #include <cstdint>
 
+#include "resource_pool.h"
+
+struct GPU {
+    wgpu::Instance instance; // XXX could avoid and use adapter.GetInstance()
+    wgpu::Adapter adapter; // XXX could avoid and use device.GetAdapter()
+    wgpu::Device device;
+
+    void release() {
+        std::cout << "Cleaning up...\n";
+
+        if (device) {
+            device.Destroy();
+        }
+    }
+};
+
+// Blocks until the adapter and device are created, giving up after a timeout. The device is null
+// when that failed. multithreaded: request FeatureName::ImplicitDeviceSynchronization if
+// available, so that the device may be used from several threads. Timestamp queries and the
+// features of SharedTextureDevice are requested when available.
+[[nodiscard]] GPU init_webgpu(bool multithreaded = false);
+
+// Blocks until all work submitted to the device queue so far has completed.
+void wait_for_queue(GPU const & gpu);
+
 uint32_t texture_format_size(wgpu::TextureFormat format);
 
 bool is_srgb(wgpu::TextureFormat format);
 
-wgpu::ImageCopyBuffer image_copy_buffer_for_texture(const wgpu::Texture & texture, uint64_t & size);
+// Layout for a copy of the top left width x height texels of texture.
+wgpu::ImageCopyBuffer image_copy_buffer_for_texture(const wgpu::Texture & texture, uint32_t width, uint32_t height, uint64_t & size);
 
 template<typename I1, typename I2 = I1
 //         ,std::enable_if_t<std::is_unsigned<I>::value, bool> = true
@@ -29,44 +55,130 @@ struct ImageDataLayout {
     uint32_t row_stride;
 };
 
+// Bounds the number of frames the CPU runs ahead of the GPU. Every frame occupies one slot until
+// Queue::OnSubmittedWorkDone reports its submissions as done; begin_frame() only blocks when the
+// slot it needs is still in flight. Per-frame resources are indexed by the slot.
+class FrameTracker {
+public:
+    static constexpr uint32_t max_frames_in_flight = 3;
+
+    FrameTracker(GPU const & gpu, uint32_t frames_in_flight = 2);
+
+    ~FrameTracker();
+
+    // Waits for the slot of the next frame to retire and returns it.
+    uint32_t begin_frame();
+
+    // Fences everything submitted since begin_frame().
+    void end_frame();
+
+    uint32_t get_slot() const {
+        return this->slot;
+    }
+
+    uint32_t get_frames_in_flight() const {
+        return this->frames_in_flight;
+    }
+
+private:
+    void wait_for_slot(uint32_t slot);
+
+    wgpu::Instance instance;
+    wgpu::Queue queue;
+    wgpu::Future fences[max_frames_in_flight];
+    bool in_flight[max_frames_in_flight] = {};
+    uint32_t frames_in_flight;
+    uint32_t slot = 0;
+    uint64_t frame_index = 0;
+};
+
+// Measures the GPU time of a frame with timestamp queries, one pair per frame slot. Does nothing
+// when the device lacks FeatureName::TimestampQuery.
+class GpuTimer {
+public:
+    GpuTimer(GPU const & gpu);
+
+    bool is_supported() const {
+        return static_cast<bool>(this->query_set);
+    }
+
+    // Bracket the GPU work of the frame recorded into encoder.
+    void begin(uint32_t slot, wgpu::CommandEncoder encoder);
+
+    void end(uint32_t slot, wgpu::CommandEncoder encoder);
+
+    // Starts reading the timestamps back. Call once the frame has been submitted.
+    void map(uint32_t slot);
+
+    // Most recent measurement in milliseconds, negative until one is available.
+    double get_last_frame_ms() const {
+        return this->last_frame_ms;
+    }
+
+private:
+    void write_timestamp(uint32_t index, wgpu::CommandEncoder encoder);
+
+    wgpu::Instance instance;
+    wgpu::QuerySet query_set;
+    wgpu::Buffer resolve_buffer;
+    // userdata of the map callback
+    struct Readback {
+        GpuTimer * timer = nullptr;
+        wgpu::Buffer buffer;
+        wgpu::Future future;
+        bool pending = false;
+    };
+
+    Readback readbacks[FrameTracker::max_frames_in_flight];
+    double last_frame_ms = -1.0;
+};
+
+// Reads textures back into per frame slot buffers (see FrameTracker). Buffers outgrown by larger
+// textures go back to pool.
 struct TextureCapture {
-    TextureCapture(wgpu::Device device)
-    : device(device) {}
+    TextureCapture(wgpu::Device device, ResourcePool& pool)
+    : device(device), pool(&pool) {}
 
-    template<typename L>
-    void push(wgpu::Texture const & texture, wgpu::CommandEncoder encoder, L callback) {
-        if (this->head == this->tail) {
-            std::cout << "Buffer queue is full\n";
-            return;
-        }
+    // Waits for pending mappings, their callbacks reference the captures.
+    ~TextureCapture();
 
-        Capture& capture = this->captures[this->head];
-        this->head = (this->head + 1) % this->count;
-        if (capture.buffer && capture.buffer.GetMapState() != wgpu::BufferMapState::Unmapped) {
+    using Callback = std::function<void(char const*, ImageDataLayout const& layout)>;
+
+    // Records the copy of the top left size texels of texture for the given frame slot. The
+    // callback receives the pixels once the copy has executed and the buffer is mapped. It is
+    // referenced, not copied, and has to outlive the read back; an empty callback drops the pixels.
+    void push(uint32_t slot, wgpu::Texture const & texture, wgpu::Extent3D size, wgpu::CommandEncoder encoder, Callback const & callback) {
+        assert(slot < FrameTracker::max_frames_in_flight);
+        Capture& capture = this->captures[slot];
+        if (!wait_unmapped(capture)) {
             std::cout << "Buffer already mapped (state: " << capture.buffer.GetMapState() <<"\n";
             return;
         }
 
-        capture.callback = callback;
+        capture.callback = &callback;
 
-        encode_texture_copy(texture, capture, encoder);
+        encode_texture_copy(texture, size, capture, encoder);
+        capture.pending = true;
     }
 
-    void pop();
+    // Starts mapping the buffer of the slot. Call once the frame has been submitted; the callback
+    // runs from Instance::ProcessEvents.
+    void pop(uint32_t slot);
 
     private:
         struct Capture {
             wgpu::Buffer buffer;
             ImageDataLayout layout;
-            std::function<void(char const*, ImageDataLayout const& layout)> callback;
+            Callback const * callback = nullptr;
             wgpu::Future future;
+            bool pending = false;
         };
 
-        void encode_texture_copy(wgpu::Texture const & texture, Capture & capture, wgpu::CommandEncoder encoder);
+        bool wait_unmapped(Capture & capture);
+
+        void encode_texture_copy(wgpu::Texture const & texture, wgpu::Extent3D size, Capture & capture, wgpu::CommandEncoder encoder);
 
-        Capture captures[3];
-        uint32_t count = 3;
-        uint32_t head = 2;
-        uint32_t tail = 0;
+        Capture captures[FrameTracker::max_frames_in_flight];
         wgpu::Device device;
+        ResourcePool* pool;
 };